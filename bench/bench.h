@@ -0,0 +1,98 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Small helpers shared by the micro benchmarks: a monotonic clock and
+ * latency summaries of a set of samples. When $BENCH_JSON names a file,
+ * each result is also appended to it as one JSON object per line, so that
+ * the results of two builds can be compared (make bench).
+ */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/* Name of the benchmark in the JSON results, set by bench_init() */
+static const char *bench_name = "bench";
+
+static inline void bench_init(const char *argv0)
+{
+	const char *slash = strrchr(argv0, '/');
+	bench_name = slash ? slash + 1 : argv0;
+}
+
+/* Open $BENCH_JSON and start a result object, NULL if there is no file */
+static inline FILE *bench_json_start(const char *name)
+{
+	const char *path = getenv("BENCH_JSON");
+	FILE *f = path ? fopen(path, "a") : NULL;
+
+	if (f) {
+		/* The names are literals of the benchmarks: no escape needed */
+		fprintf(f, "{\"bench\": \"%s\", \"name\": \"%s\"", bench_name, name);
+	}
+	return f;
+}
+
+static inline void bench_json_end(FILE *f)
+{
+	fprintf(f, "}\n");
+	fclose(f);
+}
+
+/* Record a throughput or any other single value */
+static inline void bench_json_value(const char *name, double value, const char *unit)
+{
+	FILE *f = bench_json_start(name);
+
+	if (f) {
+		fprintf(f, ", \"value\": %.6g, \"unit\": \"%s\"", value, unit);
+		bench_json_end(f);
+	}
+}
+
+/* Monotonic time in nanoseconds */
+static inline uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* Sort the n samples (in ns) and print their mean, p50 and p99 in us */
+static inline void bench_report_latency(const char *name, uint64_t *samples, size_t n)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	if (n == 0)
+		return;
+	qsort(samples, n, sizeof(uint64_t), bench_cmp_u64);
+	for (i = 0; i < n; i++)
+		sum += samples[i];
+	printf("%-24s n=%zu mean=%.1fus p50=%.1fus p99=%.1fus\n", name, n,
+	       sum / 1e3 / n, samples[n / 2] / 1e3, samples[(n * 99) / 100] / 1e3);
+
+	FILE *f = bench_json_start(name);
+	if (f) {
+		fprintf(f, ", \"n\": %zu, \"unit\": \"us\", \"mean\": %.3f, \"p50\": %.3f, "
+			"\"p99\": %.3f, \"max\": %.3f", n, sum / 1e3 / n, samples[n / 2] / 1e3,
+			samples[(n * 99) / 100] / 1e3, samples[n - 1] / 1e3);
+		bench_json_end(f);
+	}
+}
+
+#endif
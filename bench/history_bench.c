@@ -0,0 +1,133 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Large history files: time and resident size of read_history() of GNU
+ * readline against the startup of the mmap'ed history of ensishell (the
+ * last 1000 lines), then the build of its 4-gram index by the first
+ * search and the latency of the next searches (history -s TEXT).
+ * usage: history_bench [lines] [searches]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <unistd.h>
+#include <readline/history.h>
+
+#include "bench.h"
+#include "../src/histfile.h"
+
+#define HISTORY "history_bench.txt"
+
+static const char *words[] = {
+	"ls", "cat", "grep", "make", "git", "cd", "echo", "vim",
+	"ssh", "find", "sort", "awk", "sed", "tar", "cp", "rm",
+};
+
+static size_t recent;
+
+static void count_line(const char *line, size_t len)
+{
+	(void)line;
+	(void)len;
+	recent++;
+}
+
+/* Resident size of the benchmark in kB */
+static long rss_kb(void)
+{
+	char line[256];
+	long kb = 0;
+	FILE *f = fopen("/proc/self/status", "r");
+
+	while (f && fgets(line, sizeof(line), f) != NULL) {
+		if (!strncmp(line, "VmRSS:", 6))
+			kb = atol(line + 6);
+	}
+	if (f)
+		fclose(f);
+	return kb;
+}
+
+/* history -s pattern 10, its output thrown away */
+static void search(const char *pattern)
+{
+	char *argv[] = { "history", "-s", (char *)pattern, "10", NULL };
+	int out = dup(1), null = open("/dev/null", O_WRONLY);
+
+	fflush(stdout);
+	dup2(null, 1);
+	histfile_builtin(argv);
+	fflush(stdout);
+	dup2(out, 1);
+	close(out);
+	close(null);
+}
+
+int main(int argc, char **argv)
+{
+	size_t lines = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	size_t searches = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000;
+	uint64_t *samples = malloc(searches * sizeof(uint64_t));
+	char pattern[64];
+	uint64_t start;
+	long before;
+	size_t i;
+	FILE *f;
+
+	bench_init(argv[0]);
+	f = fopen(HISTORY, "w");
+	if (f == NULL) {
+		perror(HISTORY);
+		return 1;
+	}
+	srandom(1);
+	for (i = 0; i < lines; i++)
+		fprintf(f, "%s %s%ld %s%ld -o %s%ld\n", words[random() % 16],
+			words[random() % 16], random() % 100000, words[random() % 16],
+			random() % 100000, words[random() % 16], random() % 100000);
+	fclose(f);
+	unlink(HISTORY ".idx");
+
+	before = rss_kb();
+	start = bench_now_ns();
+	read_history(HISTORY);
+	double readline_ms = (bench_now_ns() - start) / 1e6;
+	printf("read_history:   %8.1f ms, %6ld kB, %d lines\n", readline_ms,
+	       rss_kb() - before, history_length);
+	bench_json_value("read_history", readline_ms, "ms");
+	clear_history();
+
+	setenv("ENSISHELL_HISTORY", HISTORY, 1);
+	before = rss_kb();
+	start = bench_now_ns();
+	histfile_open();
+	histfile_recent(1000, count_line);
+	double startup_ms = (bench_now_ns() - start) / 1e6;
+	printf("histfile start: %8.3f ms, %6ld kB, %zu lines\n", startup_ms,
+	       rss_kb() - before, recent);
+	bench_json_value("histfile startup", startup_ms, "ms");
+
+	start = bench_now_ns();
+	search("no such line");
+	double index_ms = (bench_now_ns() - start) / 1e6;
+	printf("index build:    %8.1f ms\n", index_ms);
+	bench_json_value("index build", index_ms, "ms");
+
+	for (i = 0; i < searches; i++) {
+		snprintf(pattern, sizeof(pattern), "%s%ld ", words[random() % 16],
+			 random() % 100000);
+		start = bench_now_ns();
+		search(pattern);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_latency("history -s", samples, searches);
+
+	histfile_close();
+	unlink(HISTORY);
+	unlink(HISTORY ".idx");
+	free(samples);
+	return 0;
+}
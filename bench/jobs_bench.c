@@ -0,0 +1,72 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Background job churn, like "true &" in a loop: jobs of one process
+ * launched with launch(), entered in the job table, reaped through the
+ * signalfd of the event loop and removed, with at most K of them running
+ * at a time. Reports the time from the creation of a job to its reaping,
+ * and the jobs handled per second.
+ * usage: jobs_bench [jobs] [K]
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../src/events.h"
+#include "../src/jobs.h"
+#include "../src/launcher.h"
+
+static char *true_argv[] = { "true", NULL };
+
+int main(int argc, char **argv)
+{
+	size_t total = argc > 1 ? strtoul(argv[1], NULL, 10) : 5000;
+	int concurrent = argc > 2 ? atoi(argv[2]) : 16;
+	uint64_t *samples = malloc(total * sizeof(uint64_t));
+	size_t launched = 0, done = 0;
+	int running = 0, id;
+	uint64_t start;
+
+	bench_init(argv[0]);
+	events_init(job_child_status);
+	start = bench_now_ns();
+	while (done < total) {
+		while (launched < total && running < concurrent) {
+			struct job *j = job_create("true &", 1, 0);
+			struct launch p;
+			pid_t pid;
+
+			launch_init(&p, true_argv);
+			pid = launch(&p);
+			if (pid == -1) {
+				perror("launch");
+				return 1;
+			}
+			job_add_process(j, pid);
+			launched++;
+			running++;
+		}
+		events_poll(-1, -1);
+		for (id = 1; id <= job_max_id(); id++) {
+			struct job *j = job_by_id(id);
+
+			if (j == NULL || j->state != JOB_DONE)
+				continue;
+			samples[done++] = (j->end.tv_sec - j->start.tv_sec) * 1000000000ULL
+					  + j->end.tv_nsec - j->start.tv_nsec;
+			job_remove(j);
+			running--;
+		}
+	}
+
+	double rate = total / ((bench_now_ns() - start) / 1e9);
+	printf("%d concurrent jobs: %.0f jobs/s\n", concurrent, rate);
+	bench_json_value("jobs/s", rate, "jobs/s");
+	bench_report_latency("job create to reap", samples, total);
+	free(samples);
+	return 0;
+}
@@ -0,0 +1,81 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Per-command launch latency: fork+execvp (the former execute() scheme)
+ * against launch() (posix_spawn), and launch() through the spawn server.
+ * usage: launch_bench [iterations] [ballast MiB]
+ * The ballast is touched heap memory standing for the Guile heap, whose
+ * page tables fork() has to copy. The spawn server is started before it
+ * is allocated, like ensishell --spawn-server does before Guile.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "../src/launcher.h"
+#include "../src/spawnsrv.h"
+
+static char *true_argv[] = { "true", NULL };
+
+static uint64_t run_fork(void)
+{
+	uint64_t start = bench_now_ns();
+	pid_t pid = fork();
+	if (pid == 0) {
+		execvp(true_argv[0], true_argv);
+		_exit(127);
+	}
+	waitpid(pid, NULL, 0);
+	return bench_now_ns() - start;
+}
+
+static uint64_t run_launch(void)
+{
+	struct launch p;
+	uint64_t start = bench_now_ns();
+	launch_init(&p, true_argv);
+	pid_t pid = launch(&p);
+	waitpid(pid, NULL, 0);
+	return bench_now_ns() - start;
+}
+
+int main(int argc, char **argv)
+{
+	size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+	size_t ballast = argc > 2 ? strtoul(argv[2], NULL, 10) : 256;
+	uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+	char *heap = malloc(ballast << 20);
+	size_t i;
+
+	bench_init(argv[0]);
+	if (spawn_server_start() == -1) {
+		perror("spawn server");
+		return 1;
+	}
+	memset(heap, 1, ballast << 20);
+	printf("ballast: %zu MiB\n", ballast);
+
+	for (i = 0; i < iterations; i++)
+		samples[i] = run_fork();
+	bench_report_latency("fork+execvp", samples, iterations);
+
+	for (i = 0; i < iterations; i++)
+		samples[i] = run_launch();
+	bench_report_latency("launch (spawn server)", samples, iterations);
+
+	spawn_server_stop();
+	for (i = 0; i < iterations; i++)
+		samples[i] = run_launch();
+	bench_report_latency("launch (posix_spawn)", samples, iterations);
+
+	free(heap);
+	free(samples);
+	return 0;
+}
@@ -0,0 +1,73 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * parsecmd() throughput on multi-megabyte command lines.
+ * usage: parse_bench [MiB per line] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "../src/readcmd.h"
+
+/* Fill a line of about size bytes: prefix then pattern repeated */
+static char *make_line(const char *prefix, const char *pattern, size_t size)
+{
+	size_t plen = strlen(pattern), n = strlen(prefix);
+	char *line = malloc(size + n + plen + 1);
+
+	memcpy(line, prefix, n);
+	while (n < size) {
+		memcpy(line + n, pattern, plen);
+		n += plen;
+	}
+	line[n] = 0;
+	return line;
+}
+
+static void run(const char *name, const char *prefix, const char *pattern,
+		size_t size, int iterations)
+{
+	char *model = make_line(prefix, pattern, size);
+	size_t len = strlen(model);
+	uint64_t total = 0;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		/* parsecmd() frees the line it is given */
+		char *line = strdup(model);
+		uint64_t start = bench_now_ns();
+		struct cmdline *l = parsecmd(&line);
+		total += bench_now_ns() - start;
+		if (!l || l->err) {
+			fprintf(stderr, "%s: parse error\n", name);
+			exit(1);
+		}
+	}
+	printf("%-16s %8.1f MB/s\n", name, (double)len * iterations / (total / 1e9) / 1e6);
+	bench_json_value(name, (double)len * iterations / (total / 1e9) / 1e6, "MB/s");
+	free(model);
+}
+
+int main(int argc, char **argv)
+{
+	size_t size = (argc > 1 ? strtoul(argv[1], NULL, 10) : 4) << 20;
+	int iterations = argc > 2 ? atoi(argv[2]) : 20;
+	char *end = NULL;
+
+	bench_init(argv[0]);
+	run("short-words", "ls ", "file-1234.txt ", size, iterations);
+	run("long-words", "ls ",
+	    "/usr/share/doc/some-package/examples/a-rather-long-file-name.conf ",
+	    size, iterations);
+	run("quoted", "echo ", "'single quoted arg' \"double \\\"quoted\\\" arg\" ",
+	    size, iterations);
+	run("pipeline", "cat ", "| grep -v x ", size, iterations);
+	parsecmd(&end);
+	return 0;
+}
@@ -0,0 +1,96 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Throughput of cat | cat | ... chains for several pipe sizes (see the
+ * pipesize builtin): the benchmark writes MiB bytes in the first pipe
+ * and reads them from the last one.
+ * usage: pipe_bench [MiB] [longest chain]
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "../src/launcher.h"
+#include "../src/pipes.h"
+
+#define BLOCK (128 * 1024)
+
+static char *cat_argv[] = { "cat", NULL };
+
+/* Bytes per second through a chain of nb_cats cat processes */
+static double run(const struct pipe_conf *conf, int nb_cats, size_t total)
+{
+	pid_t pids[nb_cats + 1];
+	int first[2], fd_in, tuyau[2], i;
+	static char buf[BLOCK];
+	size_t received = 0;
+	uint64_t start;
+	ssize_t n;
+
+	pipe_open(first, conf);
+	fd_in = first[0];
+	for (i = 0; i < nb_cats; i++) {
+		struct launch p;
+
+		pipe_open(tuyau, conf);
+		launch_init(&p, cat_argv);
+		p.fd_in = fd_in;
+		p.fd_out = tuyau[1];
+		pids[i] = launch(&p);
+		close(fd_in);
+		close(tuyau[1]);
+		fd_in = tuyau[0];
+	}
+
+	start = bench_now_ns();
+	pids[nb_cats] = fork();
+	if (pids[nb_cats] == 0) {
+		size_t sent;
+
+		close(fd_in);
+		for (sent = 0; sent < total; sent += BLOCK)
+			if (write(first[1], buf, BLOCK) != BLOCK)
+				_exit(1);
+		_exit(0);
+	}
+	close(first[1]);
+	while ((n = read(fd_in, buf, sizeof(buf))) > 0)
+		received += n;
+	close(fd_in);
+	for (i = 0; i <= nb_cats; i++)
+		waitpid(pids[i], NULL, 0);
+	return received / ((bench_now_ns() - start) / 1e9);
+}
+
+int main(int argc, char **argv)
+{
+	size_t total = (argc > 1 ? strtoul(argv[1], NULL, 10) : 1024) << 20;
+	int longest = argc > 2 ? atoi(argv[2]) : 8;
+	const char *specs[] = { "default", "256k", "max", "default,direct", "max,direct" };
+	size_t s;
+	int nb_cats;
+
+	bench_init(argv[0]);
+	printf("pipe-max-size: %ld\n", pipe_max_size());
+	for (s = 0; s < sizeof(specs) / sizeof(specs[0]); s++) {
+		struct pipe_conf conf;
+
+		pipe_conf_parse(specs[s], &conf);
+		for (nb_cats = 1; nb_cats <= longest; nb_cats *= 2) {
+			double rate = run(&conf, nb_cats, total) / 1e9;
+			char name[64];
+
+			printf("%-16s %2d cat %8.2f GB/s\n", specs[s], nb_cats, rate);
+			snprintf(name, sizeof(name), "%s %d cat", specs[s], nb_cats);
+			bench_json_value(name, rate, "GB/s");
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Replay of a session recorded by ensishell --record FILE. The lines are
+ * written to instances of ensishell - (batch mode on the standard input),
+ * each one followed by an echo of a marker: reading the marker back tells
+ * that the line is done, the time since it was sent is its latency.
+ * usage: replay [-p] [-j instances] [-s ensishell] trace
+ *   -p  original pacing: each line is sent at its offset in the session,
+ *       otherwise as soon as the previous one is done
+ *   -j  number of shells replaying the trace concurrently
+ * The exit lines are skipped. A recorded command reading its standard
+ * input would read the next lines, like in a script.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+#define MARKER "@@replay@@"
+
+struct entry {
+	double offset;		/* Seconds since the start of the session */
+	char *line;
+};
+
+/* Read the entries of the trace, NULL if it cannot be read */
+static struct entry *read_trace(const char *path, size_t *n)
+{
+	FILE *f = fopen(path, "r");
+	struct entry *entries = NULL;
+	size_t cap = 0, len = 0;
+	char *buf = NULL;
+	ssize_t got;
+
+	*n = 0;
+	if (f == NULL)
+		return NULL;
+	while ((got = getline(&buf, &len, f)) != -1) {
+		char *text = buf;
+		int field;
+
+		if (buf[0] == '#')
+			continue;
+		if (got > 0 && buf[got - 1] == '\n')
+			buf[got - 1] = '\0';
+		/* OFFSET DURATION STATUS LINE */
+		for (field = 0; field < 3 && text != NULL; field++) {
+			text = strchr(text, '\t');
+			if (text != NULL)
+				text++;
+		}
+		if (text == NULL || !strncmp(text, "exit", 4))
+			continue;
+		if (*n == cap) {
+			cap = cap ? 2 * cap : 1024;
+			entries = realloc(entries, cap * sizeof(struct entry));
+		}
+		entries[*n].offset = atof(buf);
+		entries[*n].line = strdup(text);
+		(*n)++;
+	}
+	free(buf);
+	fclose(f);
+	return entries;
+}
+
+/* Replay the n entries through one shell, latencies in samples */
+static void replay(const char *shell, struct entry *entries, size_t n, int paced,
+		   uint64_t *samples)
+{
+	int in[2], out[2];
+	char marker[64], *buf = NULL;
+	size_t cap = 0, i;
+	uint64_t start;
+	FILE *to, *from;
+	pid_t pid;
+
+	if (pipe(in) == -1 || pipe(out) == -1) {
+		perror("pipe");
+		exit(1);
+	}
+	pid = fork();
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+
+		dup2(in[0], 0);
+		dup2(out[1], 1);
+		dup2(null, 2);
+		close(in[0]);
+		close(in[1]);
+		close(out[0]);
+		close(out[1]);
+		execl(shell, shell, "-", (char *)NULL);
+		_exit(127);
+	}
+	close(in[0]);
+	close(out[1]);
+	to = fdopen(in[1], "w");
+	from = fdopen(out[0], "r");
+
+	start = bench_now_ns();
+	for (i = 0; i < n; i++) {
+		uint64_t sent;
+
+		if (paced) {
+			uint64_t at = start + entries[i].offset * 1e9, now = bench_now_ns();
+
+			if (at > now) {
+				struct timespec ts = { (at - now) / 1000000000, (at - now) % 1000000000 };
+				nanosleep(&ts, NULL);
+			}
+		}
+		snprintf(marker, sizeof(marker), MARKER "%zu", i);
+		sent = bench_now_ns();
+		fprintf(to, "%s\necho %s\n", entries[i].line, marker);
+		fflush(to);
+		/* The output of the command comes before the marker */
+		while (getline(&buf, &cap, from) != -1 && strstr(buf, marker) == NULL)
+			;
+		samples[i] = bench_now_ns() - sent;
+	}
+	fclose(to);
+	while (getline(&buf, &cap, from) != -1)
+		;
+	fclose(from);
+	free(buf);
+	waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char **argv)
+{
+	const char *shell = "./ensishell";
+	int paced = 0, instances = 1, opt, k;
+	struct entry *entries;
+	uint64_t *samples, start;
+	size_t n;
+	double rate;
+
+	bench_init(argv[0]);
+	/* The replayed lines stay out of the history of the user */
+	setenv("ENSISHELL_HISTORY", "", 1);
+	while ((opt = getopt(argc, argv, "pj:s:")) != -1) {
+		switch (opt) {
+		case 'p':
+			paced = 1;
+			break;
+		case 'j':
+			instances = atoi(optarg);
+			break;
+		case 's':
+			shell = optarg;
+			break;
+		default:
+			optind = argc;
+			break;
+		}
+	}
+	if (optind != argc - 1 || instances < 1) {
+		fprintf(stderr, "usage: replay [-p] [-j instances] [-s ensishell] trace\n");
+		return 2;
+	}
+	entries = read_trace(argv[optind], &n);
+	if (entries == NULL || n == 0) {
+		fprintf(stderr, "replay: %s: no line to replay\n", argv[optind]);
+		return 1;
+	}
+
+	/* The latencies measured by every instance, which are processes */
+	samples = mmap(NULL, instances * n * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	start = bench_now_ns();
+	for (k = 0; k < instances; k++) {
+		if (fork() == 0) {
+			replay(shell, entries, n, paced, samples + k * n);
+			_exit(0);
+		}
+	}
+	for (k = 0; k < instances; k++)
+		wait(NULL);
+	rate = instances * n / ((bench_now_ns() - start) / 1e9);
+
+	printf("%zu lines x %d instances%s: %.0f lines/s\n", n, instances,
+	       paced ? " (paced)" : "", rate);
+	bench_json_value("lines/s", rate, "lines/s");
+	bench_report_latency("line latency", samples, instances * n);
+	return 0;
+}
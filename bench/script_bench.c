@@ -0,0 +1,143 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Batch mode throughput: lines/s of the script line splitter against
+ * stdio getline() with the copy of each line the shell needs (and
+ * without, as a bound), then of a whole ensishell run on generated
+ * scripts.
+ * usage: script_bench [lines] [path of ensishell]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "../src/script.h"
+
+/* Write a script of nb_lines copies of line to a temporary file */
+static char *make_script(const char *line, long nb_lines)
+{
+	static char path[] = "/tmp/script_bench.XXXXXX";
+	int fd;
+	FILE *f;
+	long i;
+
+	strcpy(path + strlen(path) - 6, "XXXXXX");
+	fd = mkstemp(path);
+	f = fdopen(fd, "w");
+	for (i = 0; i < nb_lines; i++)
+		fprintf(f, "%s\n", line);
+	fclose(f);
+	return path;
+}
+
+static void report(const char *name, long nb_lines, uint64_t ns)
+{
+	printf("%-24s %10.0f lines/s\n", name, nb_lines / (ns / 1e9));
+	bench_json_value(name, nb_lines / (ns / 1e9), "lines/s");
+}
+
+/* Lines of path read by script_read_line(), each one freed like parsecmd()
+   does */
+static long split_script(const char *path)
+{
+	struct script *s = script_open(path);
+	char *line;
+	long n = 0;
+
+	while ((line = script_read_line(s)) != NULL) {
+		free(line);
+		n++;
+	}
+	script_close(s);
+	return n;
+}
+
+/* Same with getline(): the shell needs a copy of its own of each line,
+   which parsecmd() frees, unless copy is 0 */
+static long split_getline(const char *path, int copy)
+{
+	FILE *f = fopen(path, "r");
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	long n = 0;
+
+	while ((len = getline(&line, &cap, f)) != -1) {
+		if (copy)
+			free(strndup(line, len - (line[len - 1] == '\n')));
+		n++;
+	}
+	fclose(f);
+	free(line);
+	return n;
+}
+
+static void bench_splitter(long nb_lines)
+{
+	char *path = make_script("ls -l file-1234.txt | wc -l > count.txt", nb_lines);
+	uint64_t best[3] = {UINT64_MAX, UINT64_MAX, UINT64_MAX};
+	long n[3];
+	int round, k;
+
+	/* Best of 5 rounds, the readers taking turns on a file in the page
+	   cache */
+	split_getline(path, 0);
+	for (round = 0; round < 5; round++) {
+		for (k = 0; k < 3; k++) {
+			uint64_t start = bench_now_ns(), ns;
+
+			n[k] = k == 0 ? split_script(path) : split_getline(path, k == 1);
+			ns = bench_now_ns() - start;
+			if (ns < best[k])
+				best[k] = ns;
+		}
+	}
+	report("split script_read_line", n[0], best[0]);
+	report("split getline + copy", n[1], best[1]);
+	report("split getline, no copy", n[2], best[2]);
+	unlink(path);
+}
+
+static void bench_shell(const char *shell, const char *name, const char *line,
+			long nb_lines)
+{
+	char *path = make_script(line, nb_lines);
+	uint64_t start = bench_now_ns();
+	pid_t pid = fork();
+	int status;
+
+	if (pid == 0) {
+		execl(shell, shell, path, (char *)NULL);
+		perror(shell);
+		_exit(127);
+	}
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		fprintf(stderr, "%s: ensishell exited with status %d\n", name, status);
+	report(name, nb_lines, bench_now_ns() - start);
+	unlink(path);
+}
+
+int main(int argc, char **argv)
+{
+	long nb_lines = argc > 1 ? atol(argv[1]) : 1000000;
+
+	bench_init(argv[0]);
+	bench_splitter(nb_lines);
+	if (argc > 2) {
+		bench_shell(argv[2], "shell empty lines", "", nb_lines);
+		bench_shell(argv[2], "shell comments", "# nothing to run", nb_lines);
+		bench_shell(argv[2], "shell true (builtin)", "true", nb_lines);
+		/* One launch per line: fewer lines */
+		bench_shell(argv[2], "shell /bin/true", "/bin/true", nb_lines / 100);
+	}
+	return 0;
+}
@@ -0,0 +1,154 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Soak test of the memory of a long lived shell: a mix of builtins,
+ * foreground commands, pipelines and background jobs is written to an
+ * interactive ensishell, so that the lines go through readline and its
+ * history, and the resident size of the shell is sampled along the way
+ * from /proc/PID/status. Once the first quarter of the commands has warmed
+ * the allocator, the caches and the history up, the resident size must not
+ * grow by more than the tolerance.
+ * usage: soak [commands] [ensishell] [tolerance in kB]
+ * Exit status 1 if the resident size grew, 2 on usage error.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+#define NB_SAMPLES 20
+#define WARMUP (NB_SAMPLES / 4)
+#define HISTORY "soak.history"
+
+/* One round of the mix: 14 builtins, 3 commands, 2 pipelines, 1 job */
+static const char *mix[] = {
+	"true",
+	"echo soak > /dev/null",
+	"cd .",
+	"/bin/true",
+	"test -n soak",
+	"echo soak | cat > /dev/null",
+	"printf %s soak > /dev/null",
+	"false",
+	"jobs",
+	"/bin/true &",
+	"echo a b c d e f g h i j k l m n o p q r s t u v w x y z > /dev/null",
+	"[ soak = soak ]",
+	"/bin/true",
+	"pwd > /dev/null",
+	"history -s soak 1",
+	"echo soak | cat | cat > /dev/null",
+	": soak",
+	"/bin/true > /dev/null",
+	"true",
+	"echo soak",
+};
+
+#define MIX_LEN (sizeof(mix) / sizeof(mix[0]))
+
+/* Resident size of process pid in kB, -1 if it is gone */
+static long rss_kb(pid_t pid)
+{
+	char path[64], line[256];
+	long kb = -1;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (!strncmp(line, "VmRSS:", 6)) {
+			kb = atol(line + 6);
+			break;
+		}
+	}
+	fclose(f);
+	return kb;
+}
+
+int main(int argc, char **argv)
+{
+	size_t total = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	const char *shell = argc > 2 ? argv[2] : "./ensishell";
+	long tolerance = argc > 3 ? atol(argv[3]) : 256;
+	long baseline = 0, peak = 0, kb;
+	size_t sent = 0, step;
+	uint64_t start;
+	int in[2], status, k;
+	FILE *to;
+	pid_t pid;
+
+	bench_init(argv[0]);
+	if (total < NB_SAMPLES * MIX_LEN || tolerance < 0) {
+		fprintf(stderr, "usage: soak [commands >= %zu] [ensishell] [tolerance in kB]\n",
+			NB_SAMPLES * MIX_LEN);
+		return 2;
+	}
+	if (pipe(in) == -1) {
+		perror("pipe");
+		return 1;
+	}
+	/* The million lines go to a history file of their own */
+	setenv("ENSISHELL_HISTORY", HISTORY, 1);
+	unlink(HISTORY);
+	unlink(HISTORY ".idx");
+	/* A shell which died is reported, not a SIGPIPE of the driver */
+	signal(SIGPIPE, SIG_IGN);
+	pid = fork();
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+
+		dup2(in[0], 0);
+		dup2(null, 1);
+		dup2(null, 2);
+		close(in[0]);
+		close(in[1]);
+		execl(shell, shell, (char *)NULL);
+		_exit(127);
+	}
+	close(in[0]);
+	to = fdopen(in[1], "w");
+
+	/* The shell is at most a pipe worth of lines behind the samples */
+	step = total / NB_SAMPLES;
+	start = bench_now_ns();
+	for (k = 1; k <= NB_SAMPLES; k++) {
+		for (; sent < k * step; sent++)
+			fprintf(to, "%s\n", mix[sent % MIX_LEN]);
+		if (fflush(to) == EOF) {
+			fprintf(stderr, "soak: %s stopped after %zu commands\n", shell, sent);
+			return 1;
+		}
+		kb = rss_kb(pid);
+		printf("%8zu commands: %6ld kB\n", sent, kb);
+		if (k == WARMUP)
+			baseline = kb;
+		if (k >= WARMUP && kb > peak)
+			peak = kb;
+	}
+	fclose(to);
+	waitpid(pid, &status, 0);
+	unlink(HISTORY);
+	unlink(HISTORY ".idx");
+
+	double rate = sent / ((bench_now_ns() - start) / 1e9);
+	printf("%zu commands: %.0f commands/s, RSS %ld kB after warmup, peak %ld kB\n",
+	       sent, rate, baseline, peak);
+	bench_json_value("commands/s", rate, "commands/s");
+	bench_json_value("RSS growth", peak - baseline, "kB");
+	if (peak - baseline > tolerance) {
+		fprintf(stderr, "soak: RSS grew by %ld kB (tolerance %ld kB)\n",
+			peak - baseline, tolerance);
+		return 1;
+	}
+	return 0;
+}
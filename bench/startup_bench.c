@@ -0,0 +1,109 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Startup cost of ensishell: time from its launch to its first prompt,
+ * and time to run a whole session of one trivial command (ensishell -c),
+ * with a builtin, an external command and a Scheme expression.
+ * usage: startup_bench [iterations] [path of ensishell]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+/* Time until the interactive shell, reading a pipe, prints its prompt */
+static uint64_t first_prompt(const char *shell)
+{
+	int in[2], out[2];
+	char buf[4096];
+	size_t len = 0;
+	ssize_t n;
+	uint64_t start = bench_now_ns(), end = 0;
+	pid_t pid;
+
+	if (pipe(in) == -1 || pipe(out) == -1)
+		return 0;
+	pid = fork();
+	if (pid == 0) {
+		dup2(in[0], 0);
+		dup2(out[1], 1);
+		close(in[0]);
+		close(in[1]);
+		close(out[0]);
+		close(out[1]);
+		execl(shell, shell, (char *)NULL);
+		_exit(127);
+	}
+	close(in[0]);
+	close(out[1]);
+	while (end == 0 && len < sizeof(buf) - 1
+	       && (n = read(out[0], buf + len, sizeof(buf) - 1 - len)) > 0) {
+		len += n;
+		buf[len] = '\0';
+		if (strstr(buf, "ensishell>") != NULL)
+			end = bench_now_ns();
+	}
+	/* End of input: the shell exits */
+	close(in[1]);
+	while (read(out[0], buf, sizeof(buf)) > 0)
+		;
+	close(out[0]);
+	waitpid(pid, NULL, 0);
+	return end ? end - start : 0;
+}
+
+/* Time of a whole ensishell -c text run */
+static uint64_t session(const char *shell, const char *text)
+{
+	uint64_t start = bench_now_ns();
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+
+		dup2(null, 1);
+		dup2(null, 2);
+		execl(shell, shell, "-c", text, (char *)NULL);
+		_exit(127);
+	}
+	waitpid(pid, NULL, 0);
+	return bench_now_ns() - start;
+}
+
+int main(int argc, char **argv)
+{
+	size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 200;
+	const char *shell = argc > 2 ? argv[2] : "./ensishell";
+	uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+	size_t i;
+
+	bench_init(argv[0]);
+	/* The interactive shells stay out of the history of the user */
+	setenv("ENSISHELL_HISTORY", "", 1);
+	for (i = 0; i < iterations; i++)
+		samples[i] = first_prompt(shell);
+	bench_report_latency("first prompt", samples, iterations);
+
+	for (i = 0; i < iterations; i++)
+		samples[i] = session(shell, "true");
+	bench_report_latency("-c true (builtin)", samples, iterations);
+
+	for (i = 0; i < iterations; i++)
+		samples[i] = session(shell, "/bin/true");
+	bench_report_latency("-c /bin/true", samples, iterations);
+
+	/* Pays for the Guile initialisation, when it is built in */
+	for (i = 0; i < iterations; i++)
+		samples[i] = session(shell, "(+ 1 2)");
+	bench_report_latency("-c scheme expression", samples, iterations);
+
+	free(samples);
+	return 0;
+}
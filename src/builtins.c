@@ -0,0 +1,536 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "builtins.h"
+
+int true_builtin(char** argv) {
+    (void)argv;
+    return 0;
+}
+
+int false_builtin(char** argv) {
+    (void)argv;
+    return 1;
+}
+
+// Decode the escape sequence whose backslash is at *s and move *s after it.
+// Octal escapes are \0nnn for echo and %b (zero_octal), \nnn in printf
+// formats. Return the byte, or -1 for \c which ends the output.
+static int decode_escape(const char** s, int zero_octal) {
+    const char* p = *s + 1;
+    int value = 0;
+    int digits = 0;
+
+    switch (*p) {
+    case 'a': value = '\a'; p++; break;
+    case 'b': value = '\b'; p++; break;
+    case 'e': value = 033; p++; break;
+    case 'f': value = '\f'; p++; break;
+    case 'n': value = '\n'; p++; break;
+    case 'r': value = '\r'; p++; break;
+    case 't': value = '\t'; p++; break;
+    case 'v': value = '\v'; p++; break;
+    case '\\': value = '\\'; p++; break;
+    case 'c':
+        *s = p + 1;
+        return -1;
+    case 'x':
+        for (p++; digits < 2 && isxdigit((unsigned char)*p); digits++, p++) {
+            value = value * 16 + (isdigit((unsigned char)*p) ? *p - '0' : tolower(*p) - 'a' + 10);
+        }
+        if (digits == 0) {
+            // Not an escape: the backslash is printed as is
+            value = '\\';
+            p = *s + 1;
+        }
+        break;
+    default:
+        if (zero_octal ? *p != '0' : (*p < '0' || *p > '7')) {
+            value = '\\';
+            break;
+        }
+        if (zero_octal) {
+            p++;
+        }
+        for (; digits < 3 && *p >= '0' && *p <= '7'; digits++, p++) {
+            value = value * 8 + (*p - '0');
+        }
+        break;
+    }
+    *s = p;
+    return value & 0xff;
+}
+
+// Print s with its escapes decoded. Return 1 if \c ended the output.
+static int put_escaped(const char* s) {
+    while (*s != '\0') {
+        if (*s != '\\') {
+            putchar(*s++);
+            continue;
+        }
+        int c = decode_escape(&s, 1);
+        if (c == -1) {
+            return 1;
+        }
+        putchar(c);
+    }
+    return 0;
+}
+
+// echo [-neE] [arg...]
+int echo_builtin(char** argv) {
+    int newline = 1;
+    int escapes = 0;
+    int i = 1;
+
+    // Options, as long as every letter is one of n, e or E
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (argv[i][strspn(argv[i] + 1, "neE") + 1] != '\0') {
+            break;
+        }
+        for (char* o = argv[i] + 1; *o; o++) {
+            if (*o == 'n') {
+                newline = 0;
+            } else {
+                escapes = (*o == 'e');
+            }
+        }
+    }
+    for (int first = i; argv[i] != NULL; i++) {
+        if (i > first) {
+            putchar(' ');
+        }
+        if (!escapes) {
+            fputs(argv[i], stdout);
+        } else if (put_escaped(argv[i])) {
+            return 0;
+        }
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    return 0;
+}
+
+// Next argument of printf, NULL once they are all used
+static const char* next_arg(char*** args) {
+    return **args != NULL ? *(*args)++ : NULL;
+}
+
+static long long next_int(char*** args, int* status) {
+    const char* arg = next_arg(args);
+    char* end;
+
+    if (arg == NULL) {
+        return 0;
+    }
+    if (arg[0] == '\'' || arg[0] == '"') {
+        // Value of the character following the quote
+        return (unsigned char)arg[1];
+    }
+    errno = 0;
+    long long value = strtoll(arg, &end, 0);
+    if (end == arg || *end != '\0' || errno != 0) {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *status = 1;
+    }
+    return value;
+}
+
+static double next_double(char*** args, int* status) {
+    const char* arg = next_arg(args);
+    char* end;
+
+    if (arg == NULL) {
+        return 0;
+    }
+    double value = strtod(arg, &end);
+    if (end == arg || *end != '\0') {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *status = 1;
+    }
+    return value;
+}
+
+// printf of one value with the conversion spec and its '*' width/precision
+#define PRINT_SPEC(value)                                                     \
+    (nb_star == 0 ? printf(spec, value)                                       \
+     : nb_star == 1 ? printf(spec, star[0], value)                           \
+     : printf(spec, star[0], star[1], value))
+
+// Print the format once, taking the values from *args.
+// Return 1 if the output must stop (\c or invalid format).
+static int print_format(const char* f, char*** args, int* status) {
+    while (*f != '\0') {
+        if (*f == '\\') {
+            int c = decode_escape(&f, 0);
+            if (c == -1) {
+                return 1;
+            }
+            putchar(c);
+            continue;
+        }
+        if (*f != '%') {
+            putchar(*f++);
+            continue;
+        }
+        if (f[1] == '%') {
+            putchar('%');
+            f += 2;
+            continue;
+        }
+
+        // Flags, width and precision are given to printf as they are
+        char spec[64];
+        size_t n = 0;
+        int star[2];
+        int nb_star = 0;
+        spec[n++] = *f++;
+        while (*f != '\0' && strchr("-+ #0", *f) && n < 16) {
+            spec[n++] = *f++;
+        }
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*f != '.') {
+                    break;
+                }
+                spec[n++] = *f++;
+            }
+            if (*f == '*') {
+                spec[n++] = *f++;
+                star[nb_star++] = (int)next_int(args, status);
+            } else {
+                while (isdigit((unsigned char)*f) && n < 48) {
+                    spec[n++] = *f++;
+                }
+            }
+        }
+        // Length modifiers are useless: the values are converted here
+        while (*f != '\0' && strchr("hlLqjzt", *f)) {
+            f++;
+        }
+
+        char conv = *f++;
+        switch (conv) {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            spec[n++] = 'l';
+            spec[n++] = 'l';
+            spec[n++] = conv;
+            spec[n] = '\0';
+            PRINT_SPEC(next_int(args, status));
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec[n++] = conv;
+            spec[n] = '\0';
+            PRINT_SPEC(next_double(args, status));
+            break;
+        case 'c': {
+            const char* arg = next_arg(args);
+            spec[n++] = 'c';
+            spec[n] = '\0';
+            PRINT_SPEC(arg ? arg[0] : '\0');
+            break;
+        }
+        case 's': {
+            const char* arg = next_arg(args);
+            spec[n++] = 's';
+            spec[n] = '\0';
+            PRINT_SPEC(arg ? arg : "");
+            break;
+        }
+        case 'b': {
+            const char* arg = next_arg(args);
+            if (arg && put_escaped(arg)) {
+                return 1;
+            }
+            break;
+        }
+        case '\0':
+            fprintf(stderr, "printf: missing format character\n");
+            *status = 1;
+            return 1;
+        default:
+            fprintf(stderr, "printf: %%%c: invalid format character\n", conv);
+            *status = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// printf format [arg...]
+int printf_builtin(char** argv) {
+    if (argv[1] == NULL) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    char** args = argv + 2;
+    int status = 0;
+    // The format is used again while some arguments are left
+    while (1) {
+        char** first = args;
+        if (print_format(argv[1], &args, &status) || args == first || *args == NULL) {
+            break;
+        }
+    }
+    return status;
+}
+
+// cd [dir|-]
+int cd_builtin(char** argv) {
+    const char* dir = argv[1];
+    int print = 0;
+
+    if (dir != NULL && argv[2] != NULL) {
+        fprintf(stderr, "cd: too many arguments\n");
+        return 1;
+    }
+    if (dir == NULL && (dir = getenv("HOME")) == NULL) {
+        fprintf(stderr, "cd: HOME not set\n");
+        return 1;
+    }
+    if (!strcmp(dir, "-")) {
+        if ((dir = getenv("OLDPWD")) == NULL) {
+            fprintf(stderr, "cd: OLDPWD not set\n");
+            return 1;
+        }
+        print = 1;
+    }
+
+    char* old = getcwd(NULL, 0);
+    if (chdir(dir) == -1) {
+        fprintf(stderr, "cd: %s: %s\n", dir, strerror(errno));
+        free(old);
+        return 1;
+    }
+    char* cwd = getcwd(NULL, 0);
+    if (old != NULL) {
+        setenv("OLDPWD", old, 1);
+    }
+    if (cwd != NULL) {
+        setenv("PWD", cwd, 1);
+        if (print) {
+            puts(cwd);
+        }
+    }
+    free(old);
+    free(cwd);
+    return 0;
+}
+
+int pwd_builtin(char** argv) {
+    (void)argv;
+    char* cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        fprintf(stderr, "pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    puts(cwd);
+    free(cwd);
+    return 0;
+}
+
+/*
+ * test: recursive descent on the arguments,
+ *   or  := and ( -o and )*
+ *   and := not ( -a not )*
+ *   not := ! not | ( or ) | unary-op arg | arg binary-op arg | arg
+ * where a binary operator in second position wins, so that [ ! = x ]
+ * and [ ( = ( ] compare strings like in the POSIX rules.
+ */
+struct test_state {
+    char** argv;
+    int argc;
+    int pos;
+    const char* error;
+};
+
+static const char* test_peek(struct test_state* t, int k) {
+    return t->pos + k < t->argc ? t->argv[t->pos + k] : NULL;
+}
+
+static int test_is_binary(const char* s) {
+    static const char* ops[] = {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+        "-nt", "-ot", "-ef", NULL,
+    };
+    for (int i = 0; ops[i] != NULL; i++) {
+        if (!strcmp(s, ops[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int test_is_unary(const char* s) {
+    return s[0] == '-' && s[1] != '\0' && s[2] == '\0' && strchr("bcdefghknprstuwxzGLOS", s[1]);
+}
+
+static long long test_int(struct test_state* t, const char* s) {
+    char* end;
+    long long value = strtoll(s, &end, 10);
+    while (isspace((unsigned char)*end)) {
+        end++;
+    }
+    if (end == s || *end != '\0') {
+        t->error = "integer expression expected";
+    }
+    return value;
+}
+
+static int test_unary(struct test_state* t, char op, const char* arg) {
+    struct stat st;
+
+    switch (op) {
+    case 'n': return arg[0] != '\0';
+    case 'z': return arg[0] == '\0';
+    case 't': return isatty((int)test_int(t, arg));
+    case 'r': return access(arg, R_OK) == 0;
+    case 'w': return access(arg, W_OK) == 0;
+    case 'x': return access(arg, X_OK) == 0;
+    case 'h':
+    case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    }
+    if (stat(arg, &st) == -1) {
+        return 0;
+    }
+    switch (op) {
+    case 'e': return 1;
+    case 'f': return S_ISREG(st.st_mode);
+    case 'd': return S_ISDIR(st.st_mode);
+    case 'b': return S_ISBLK(st.st_mode);
+    case 'c': return S_ISCHR(st.st_mode);
+    case 'p': return S_ISFIFO(st.st_mode);
+    case 'S': return S_ISSOCK(st.st_mode);
+    case 's': return st.st_size > 0;
+    case 'g': return (st.st_mode & S_ISGID) != 0;
+    case 'u': return (st.st_mode & S_ISUID) != 0;
+    case 'k': return (st.st_mode & S_ISVTX) != 0;
+    case 'O': return st.st_uid == geteuid();
+    case 'G': return st.st_gid == getegid();
+    }
+    return 0;
+}
+
+static int test_binary(struct test_state* t, const char* a, const char* op, const char* b) {
+    if (!strcmp(op, "=") || !strcmp(op, "==")) return strcmp(a, b) == 0;
+    if (!strcmp(op, "!=")) return strcmp(a, b) != 0;
+    if (!strcmp(op, "<")) return strcmp(a, b) < 0;
+    if (!strcmp(op, ">")) return strcmp(a, b) > 0;
+
+    if (op[1] == 'n' || op[1] == 'o' || !strcmp(op, "-ef")) {
+        struct stat sa, sb;
+        int ha = stat(a, &sa) == 0;
+        int hb = stat(b, &sb) == 0;
+        if (!strcmp(op, "-ef")) {
+            return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        }
+        if (!ha || !hb) {
+            // An existing file is newer than a missing one
+            return op[1] == 'n' ? ha : hb;
+        }
+        long long diff = (long long)(sa.st_mtim.tv_sec - sb.st_mtim.tv_sec) * 1000000000LL
+                         + (sa.st_mtim.tv_nsec - sb.st_mtim.tv_nsec);
+        return op[1] == 'n' ? diff > 0 : diff < 0;
+    }
+
+    long long x = test_int(t, a);
+    long long y = test_int(t, b);
+    if (!strcmp(op, "-eq")) return x == y;
+    if (!strcmp(op, "-ne")) return x != y;
+    if (!strcmp(op, "-lt")) return x < y;
+    if (!strcmp(op, "-le")) return x <= y;
+    if (!strcmp(op, "-gt")) return x > y;
+    return x >= y;
+}
+
+static int test_or(struct test_state* t);
+
+static int test_not(struct test_state* t) {
+    const char* a = test_peek(t, 0);
+    if (a == NULL) {
+        t->error = "argument expected";
+        return 0;
+    }
+    const char* op = test_peek(t, 1);
+    if (op != NULL && test_is_binary(op) && test_peek(t, 2) != NULL) {
+        t->pos += 3;
+        return test_binary(t, a, op, t->argv[t->pos - 1]);
+    }
+    if (op != NULL && !strcmp(a, "!")) {
+        t->pos++;
+        return !test_not(t);
+    }
+    if (op != NULL && !strcmp(a, "(")) {
+        t->pos++;
+        int value = test_or(t);
+        if (test_peek(t, 0) == NULL || strcmp(test_peek(t, 0), ")")) {
+            t->error = "')' expected";
+            return 0;
+        }
+        t->pos++;
+        return value;
+    }
+    if (op != NULL && test_is_unary(a)) {
+        t->pos += 2;
+        return test_unary(t, a[1], op);
+    }
+    t->pos++;
+    return a[0] != '\0';
+}
+
+static int test_and(struct test_state* t) {
+    int value = test_not(t);
+    while (!t->error && test_peek(t, 0) != NULL && !strcmp(test_peek(t, 0), "-a")) {
+        t->pos++;
+        value = test_not(t) && value;
+    }
+    return value;
+}
+
+static int test_or(struct test_state* t) {
+    int value = test_and(t);
+    while (!t->error && test_peek(t, 0) != NULL && !strcmp(test_peek(t, 0), "-o")) {
+        t->pos++;
+        value = test_and(t) || value;
+    }
+    return value;
+}
+
+// test expr, [ expr ]
+int test_builtin(char** argv) {
+    struct test_state t = {argv + 1, 0, 0, NULL};
+    while (t.argv[t.argc] != NULL) {
+        t.argc++;
+    }
+    if (!strcmp(argv[0], "[")) {
+        if (t.argc == 0 || strcmp(t.argv[t.argc - 1], "]")) {
+            fprintf(stderr, "[: missing `]'\n");
+            return 2;
+        }
+        t.argc--;
+    }
+    if (t.argc == 0) {
+        return 1;
+    }
+
+    int value = test_or(&t);
+    if (!t.error && t.pos < t.argc) {
+        t.error = "too many arguments";
+    }
+    if (t.error) {
+        fprintf(stderr, "%s: %s\n", argv[0], t.error);
+        return 2;
+    }
+    return !value;
+}
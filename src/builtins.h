@@ -0,0 +1,30 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __BUILTINS_H
+#define __BUILTINS_H
+
+/* Common commands run by the shell itself rather than by fork+exec.
+   They take the null terminated argv of the command, write on the
+   standard output and error streams, and return an exit status. */
+
+int true_builtin(char** argv);
+int false_builtin(char** argv);
+
+/* echo [-neE] [arg...] */
+int echo_builtin(char** argv);
+
+/* printf format [arg...], the format being reused for extra arguments */
+int printf_builtin(char** argv);
+
+/* cd [dir|-], which updates PWD and OLDPWD */
+int cd_builtin(char** argv);
+
+int pwd_builtin(char** argv);
+
+/* test expr, or [ expr ] when argv[0] is "[" */
+int test_builtin(char** argv);
+
+#endif
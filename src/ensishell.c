@@ -5,6 +5,7 @@
  * Ce code est distribué sous la licence GPLv3+.     *
  *****************************************************/
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,8 +13,25 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <errno.h>
 
 #include "readcmd.h"
+#include "launcher.h"
+#include "pathcache.h"
+#include "events.h"
+#include "jobs.h"
+#include "script.h"
+#include "builtins.h"
+#include "parallel.h"
+#include "shard.h"
+#include "fanout.h"
+#include "pipes.h"
+#include "spawnsrv.h"
+#include "joblog.h"
+#include "placement.h"
+#include "stats.h"
+#include "record.h"
+#include "histfile.h"
 #include "variante.h"
 
 #ifndef VARIANTE
@@ -28,276 +46,986 @@
 
 #if USE_GUILE == 1
 #include <libguile.h>
+#endif
 
-void execute(char** cmd, struct cmdline* l, int nb_args);
+// Lines kept by readline for the arrow keys and the searches
+#define HISTORY_SIZE 1000
 
-int question6_executer(char* line) {
-    /* Question 6: Insert your code to execute the command line
-     * identically to the standard execution scheme:
-     * parsecmd, then fork+execvp, for a single command.
-     * pipe and i/o redirection are not required.
-     */
+// Set by ensishell -c or a script argument: no prompt nor debug output
+static int batch = 0;
+// Lines of the batch mode, NULL in interactive mode
+static struct script* script = NULL;
+// Exit status of the last foreground command, returned by a batch shell
+static int last_status = 0;
 
-     /* parsecmd free line and set it up to 0 */
-    struct cmdline* l = parsecmd(&line);
+void terminate(char* line) {
+    record_end(last_status);
+    if (line) free(line);
+    stats_dump();
 
-    if (l->err) {
-        /* Syntax error, read another command */
-        printf("error: %s\n", l->err);
+    // Everything the shell owns goes back, so that a leak checker reports
+    // the real leaks only. The background jobs keep running, unreported.
+#if USE_GNU_READLINE == 1
+    /* rl_clear_history() does not exist yet in centOS 6 */
+    clear_history();
+#endif
+    char* none = NULL;
+    parsecmd(&none);
+    jobs_clear();
+    joblog_clear();
+    record_close();
+    path_destroy();
+    histfile_close();
+    spawn_server_stop();
+    if (script != NULL) {
+        script_close(script);
+        script = NULL;
     }
+    if (batch) {
+        exit(last_status);
+    }
+    printf("exit\n");
+    exit(0);
+}
 
-    if (l->seq[0] != NULL) {
-        int nb_args = 0;
-        char** cmd = l->seq[0];
-        for (int j = 0; cmd[j] != 0; j++) {
-            ++nb_args;
+// Text of a command line, as shown by jobs. Free it after use.
+static char* cmdline_text(struct cmdline* l) {
+    size_t len = 1;
+    for (int i = 0; l->seq[i] != NULL; i++) {
+        // Room for the |Nk operator of a replicated command
+        len += 16;
+        for (int j = 0; l->seq[i][j] != NULL; j++) {
+            len += strlen(l->seq[i][j]) + 3;
         }
-        execute(cmd, l, nb_args);
-        printf("\n");
+    }
+    len += (l->in ? strlen(l->in) + 3 : 0) + (l->out ? strlen(l->out) + 3 : 0);
+    for (int i = 0; l->outs && l->outs[i] != NULL; i++) {
+        len += strlen(l->outs[i]) + 4;
     }
 
-    return 0;
+    char* text = malloc(len);
+    char* cur = text;
+    for (int i = 0; l->seq[i] != NULL; i++) {
+        if (l->stages[i].shards > 1) {
+            cur += sprintf(cur, " |%d%s", l->stages[i].shards, l->stages[i].ordered ? "k" : "");
+        } else if (i) {
+            cur += sprintf(cur, " |");
+        }
+        for (int j = 0; l->seq[i][j] != NULL; j++) {
+            cur += sprintf(cur, "%s%s", (i || j) ? " " : "", l->seq[i][j]);
+        }
+    }
+    if (l->in) {
+        cur += sprintf(cur, " < %s", l->in);
+    }
+    if (l->out) {
+        cur += sprintf(cur, " > %s", l->out);
+    }
+    for (int i = 0; l->outs && l->outs[i] != NULL; i++) {
+        cur += sprintf(cur, "%s%s", i ? " " : " >+ ", l->outs[i]);
+    }
+    *cur = '\0';
+    return text;
 }
 
-SCM executer_wrapper(SCM x) {
-    return scm_from_int(question6_executer(scm_to_locale_stringn(x, 0)));
+static const char* job_state_name(struct job* j) {
+    switch (j->state) {
+    case JOB_RUNNING:
+        return "Running";
+    case JOB_STOPPED:
+        return "Stopped";
+    default:
+        return "Done";
+    }
 }
-#endif
 
-void terminate(char* line) {
-#if USE_GNU_READLINE == 1
-    /* rl_clear_history() does not exist yet in centOS 6 */
-    clear_history();
-#endif
-    if (line) free(line);
-    printf("exit\n");
-    exit(0);
+// Print resource usage like the time keyword of bash (format 1) or POSIX (2)
+static void print_usage(struct job_usage* u, int format) {
+    if (format == 2) {
+        fprintf(stderr, "real %.2f\nuser %.2f\nsys %.2f\n", u->real, u->user, u->sys);
+        return;
+    }
+    fprintf(stderr, "\nreal\t%dm%.3fs\nuser\t%dm%.3fs\nsys\t%dm%.3fs\n",
+            (int)(u->real / 60), u->real - 60 * (int)(u->real / 60),
+            (int)(u->user / 60), u->user - 60 * (int)(u->user / 60),
+            (int)(u->sys / 60), u->sys - 60 * (int)(u->sys / 60));
+    fprintf(stderr, "maxrss\t%ld kB\nctxsw\t%ld voluntary, %ld involuntary\n",
+            u->maxrss, u->nvcsw, u->nivcsw);
 }
 
-struct jobc {
-    char** cmd;
-    pid_t pid;
-    struct jobc* next;
-};
+// Report the resources used by a job started with the time prefix
+static void report_time(struct job* j) {
+    struct job_usage u;
+    job_usage(j, -1, &u);
+    print_usage(&u, j->timed);
+    if (j->timed == 2 || j->nb_procs < 2) {
+        return;
+    }
+    for (int i = 0; i < j->nb_procs; i++) {
+        job_usage(j, i, &u);
+        fprintf(stderr, "[stage %d]\tuser %.3fs\tsys %.3fs\tmaxrss %ld kB\tctxsw %ld/%ld\n",
+                i, u.user, u.sys, u.maxrss, u.nvcsw, u.nivcsw);
+    }
+}
 
-struct jobc* jobs = NULL;
+void print_jobs() {
+    for (int id = 1; id <= job_max_id(); id++) {
+        struct job* j = job_by_id(id);
+        if (j == NULL || j->foreground || j->state == JOB_DONE) {
+            // Done jobs are reported and removed before the next prompt
+            continue;
+        }
+        struct job_usage u;
+        job_usage(j, -1, &u);
+        printf("[%d]\t%d\t%s\t%.1fs\t%.2fu %.2fs\t%ldk\t%s\n", j->id, j->pgid,
+               job_state_name(j), u.real, u.user, u.sys, u.maxrss, j->text);
+    }
+}
 
-void push_jobc(char** cmd, int pid, int nb_args) {
-    struct jobc* new = malloc(sizeof(struct jobc));
-    new->cmd = calloc(nb_args, sizeof(char*));
-    for (int i = 0; cmd[i] != NULL; i++) {
-        new->cmd[i] = malloc(strlen(cmd[i]) + 1);
-        strcpy(new->cmd[i], cmd[i]);
+// Tell that the job was killed by its timeout= limit
+static void report_timeout(struct job* j) {
+    if (j->timed_out) {
+        fprintf(stderr, "%s: timed out\n", j->text);
     }
-    new->pid = pid;
-    new->next = jobs;
-    jobs = new;
 }
 
-// Remove pid from jobs
-void remove_jobc(int pid) {
-    struct jobc* ptr;
-    struct jobc* old = NULL;
-    for (ptr = jobs; ptr != NULL; ptr = ptr->next) {
-        if (ptr->pid == pid) {
-            if (old == NULL) {
-                jobs = ptr->next;
-            }
-            else {
-                old->next = ptr->next;
-            }
-            free(ptr->cmd);
-            free(ptr);
-        }
-        old = ptr;
+// Report the end of the background job j and remove it from the table
+static void report_done(struct job* j) {
+    printf("[%d] Le fils [%d: %s] est terminé\n", j->id, j->pgid, j->text);
+    joblog_report(j->id);
+    report_timeout(j);
+    if (j->timed) {
+        report_time(j);
     }
+    job_remove(j);
 }
 
-// Return process name
-struct jobc* search_jobc(int pid) {
-    struct jobc* ptr;
-    for (ptr = jobs; ptr != NULL; ptr = ptr->next) {
-        if (ptr->pid == pid) {
-            return ptr;
+// Report the background jobs which have ended and remove them from the table
+void notify_jobs() {
+    for (int id = 1; id <= job_max_id(); id++) {
+        struct job* j = job_by_id(id);
+        if (j != NULL && !j->foreground && j->state == JOB_DONE) {
+            report_done(j);
         }
     }
-    return NULL;
 }
 
+// Give the terminal to the process group pgid, if the shell owns it
+static void give_terminal(pid_t pgid) {
+    if (isatty(0) && tcgetpgrp(0) == getpgrp()) {
+        tcsetpgrp(0, pgid);
+    }
+}
+
+// Take the terminal back after a foreground job
+static void take_terminal() {
+    if (isatty(0)) {
+        tcsetpgrp(0, getpgrp());
+    }
+}
 
-void print_jobc() {
-    int state;
-    int process_state;
-    for (struct jobc* ptr = jobs; ptr != NULL; ptr = ptr->next) {
-        process_state = waitpid(ptr->pid, &state, WNOHANG);
-        if (process_state == ptr->pid) {
-            // If process ptr->pid has ended, remove it from jobs list
-            remove_jobc(ptr->pid);
-            continue;
-        }
-        printf("\n");
-        printf("[%i]\t", ptr->pid);
-        for (int i = 0; ptr->cmd[i] != NULL; i++) {
-            printf("%s ", ptr->cmd[i]);
+// Explain why launch() failed for p: its command or a redirection
+static void report_launch_error(struct launch* p) {
+    int err = errno;
+    last_status = 127;
+    if (p->failed) {
+        last_status = 1;
+        printf("%s: %s\n", p->failed, strerror(err));
+    } else if (err == ENOENT) {
+        printf("Command %s not recognized\n", p->argv[0]);
+    } else {
+        printf("[ERROR] %s: %s\n", p->argv[0], strerror(err));
+    }
+}
+
+// Print the stages of a pipeline which did not exit successfully. SIGPIPE
+// is the normal end of a writer whose reader is done (yes | head).
+static void report_pipe_status(struct job* j) {
+    if (j->nb_procs < 2) {
+        return;
+    }
+    for (int i = 0; i < j->nb_procs; i++) {
+        if (WIFEXITED(j->status[i]) && WEXITSTATUS(j->status[i]) != 0) {
+            fprintf(stderr, "[stage %d] exited with status %d\n", i, WEXITSTATUS(j->status[i]));
+        } else if (WIFSIGNALED(j->status[i]) && WTERMSIG(j->status[i]) != SIGPIPE) {
+            fprintf(stderr, "[stage %d] killed by signal %d\n", i, WTERMSIG(j->status[i]));
         }
     }
 }
 
-void exec_pipe(struct cmdline* l) {
-    char*** cmd = l->seq;
-    int tuyau[2], fd_in = 0, to_close = -1;
-    for (int i = 0; cmd[i] != NULL; i++) {
-        if (pipe(tuyau) == -1) {
-            printf("Pipe creation has failed");
-        }
-        pid_t pid = fork();
-
-        if (pid == 0) {
-            // Connect the standard input
-            int stdin_copy, stdout_copy, fd_out;
-            if (l->in && i == 0) {
-                stdin_copy = dup(0);
-                close(0);
-                // fd_in must be 0
-                fd_in = open(l->in, O_RDONLY);
-                if (fd_in == -1) {
-                    perror("[ERROR] open");
-                    exit(EXIT_FAILURE);
-                }
-            } else {
-                // fd_in is either the standard input or the previous pipe output
-                dup2(fd_in, 0);
-                // Close the previous pipe output duplicated
-                if (to_close != -1) {
-                    close(to_close);
-                }
-            }
+// Wait until the job is stopped or all its processes are reaped
+static void wait_job(struct job* j) {
+    while (j->state == JOB_RUNNING) {
+        events_poll(-1, -1);
+    }
+}
 
-            // Connect the standard output
-            if (l->out && cmd[i + 1] == NULL) {
-                stdout_copy = dup(1);
-                close(0);
-                // fd_out must be 1
-                fd_out = open(l->out, O_WRONLY | O_TRUNC | O_CREAT, 0644);
-                if (fd_out == -1) {
-                    perror("[ERROR] open");
-                    exit(EXIT_FAILURE);
-                }
-            } else if (cmd[i + 1] != NULL) {
-                // If there is one more command after this one,
-                // connect the standard output to the input of the pipe
-                dup2(tuyau[1], 1);
+// Run the job in foreground until it ends or is stopped (Ctrl-Z). Return 1
+// if it ended, with the resources it used in *u unless u is null.
+static int run_foreground(struct job* j, struct job_usage* u) {
+    j->foreground = 1;
+    give_terminal(j->pgid);
+    uint64_t start = stats_now();
+    wait_job(j);
+    stats_add(STAT_WAIT, stats_now() - start);
+    take_terminal();
+    if (j->state == JOB_STOPPED) {
+        j->foreground = 0;
+        printf("\n[%d]\t%d\t%s\t%s\n", j->id, j->pgid, job_state_name(j), j->text);
+        return 0;
+    }
+    int status = j->status[j->nb_procs - 1];
+    last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    report_pipe_status(j);
+    report_timeout(j);
+    if (j->timed) {
+        report_time(j);
+    }
+    if (u != NULL) {
+        job_usage(j, -1, u);
+    }
+    job_remove(j);
+    return 1;
+}
+
+// Foreground run, or report of a job just launched in background
+static void start_job(struct job* j) {
+    if (j->nb_procs == 0) {
+        job_remove(j);
+    } else if (j->foreground) {
+        run_foreground(j, NULL);
+    } else {
+        printf("[%d] %d\n", j->id, j->pgid);
+    }
+}
+
+// Job designated by the argument of fg, bg, wait or kill: %N or a pid
+static struct job* job_from_arg(char* builtin, char* arg) {
+    struct job* j;
+    if (arg == NULL) {
+        j = job_from_spec("%%");
+    } else if (arg[0] == '%') {
+        j = job_from_spec(arg);
+    } else {
+        j = job_by_pid(atoi(arg));
+    }
+    if (j == NULL) {
+        printf("%s: %s: no such job\n", builtin, arg ? arg : "current");
+    }
+    return j;
+}
+
+// fg [%N]
+int fg_builtin(char** cmd) {
+    struct job* j = job_from_arg("fg", cmd[1]);
+    if (j == NULL) {
+        return 1;
+    }
+    printf("%s\n", j->text);
+    // Reaped since the last prompt: its status is reported, not waited for
+    if (j->state != JOB_DONE) {
+        j->state = JOB_RUNNING;
+        kill(-j->pgid, SIGCONT);
+    }
+    run_foreground(j, NULL);
+    return last_status;
+}
+
+// bg [%N]
+int bg_builtin(char** cmd) {
+    struct job* j = job_from_arg("bg", cmd[1]);
+    if (j == NULL) {
+        return 1;
+    }
+    if (j->state == JOB_DONE) {
+        report_done(j);
+        return 0;
+    }
+    j->state = JOB_RUNNING;
+    kill(-j->pgid, SIGCONT);
+    printf("[%d] %s &\n", j->id, j->text);
+    return 0;
+}
+
+// wait [%N|pid...]: without argument, wait for all the running jobs
+int wait_builtin(char** cmd) {
+    if (cmd[1] == NULL) {
+        for (int id = 1; id <= job_max_id(); id++) {
+            struct job* j = job_by_id(id);
+            if (j != NULL && !j->foreground) {
+                wait_job(j);
             }
+        }
+        return 0;
+    }
+    int status = 0;
+    for (int i = 1; cmd[i] != NULL; i++) {
+        struct job* j = job_from_arg("wait", cmd[i]);
+        if (j != NULL) {
+            wait_job(j);
+        } else {
+            status = 127;
+        }
+    }
+    return status;
+}
 
-            close(tuyau[0]);
-            close(tuyau[1]);
-            execvp(cmd[i][0], cmd[i]);
+static const struct {
+    const char* name;
+    int sig;
+} signal_names[] = {
+    {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL},
+    {"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM},
+    {"TERM", SIGTERM}, {"CHLD", SIGCHLD}, {"CONT", SIGCONT}, {"STOP", SIGSTOP},
+    {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU}, {"WINCH", SIGWINCH},
+};
 
-            if (l->in && i == 0) {
-                close(fd_in);
-                dup2(stdin_copy, 0);
-                close(stdin_copy);
+// Signal number of name (9, KILL or SIGKILL), -1 if unknown
+static int parse_signal(const char* name) {
+    char* end;
+    long sig = strtol(name, &end, 10);
+    if (*name != '\0' && *end == '\0') {
+        return sig > 0 && sig < NSIG ? sig : -1;
+    }
+    if (!strncmp(name, "SIG", 3)) {
+        name += 3;
+    }
+    for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++) {
+        if (!strcmp(name, signal_names[i].name)) {
+            return signal_names[i].sig;
+        }
+    }
+    return -1;
+}
+
+// kill [-SIG | -s SIG] %N|pid...
+int kill_builtin(char** cmd) {
+    int sig = SIGTERM;
+    int i = 1;
+    if (cmd[1] != NULL && cmd[1][0] == '-' && cmd[1][1] != '\0') {
+        char* name = cmd[1] + 1;
+        i = 2;
+        if (!strcmp(cmd[1], "-s") && cmd[2] != NULL) {
+            name = cmd[2];
+            i = 3;
+        }
+        if ((sig = parse_signal(name)) == -1) {
+            printf("kill: %s: invalid signal specification\n", name);
+            return 1;
+        }
+    }
+    if (cmd[i] == NULL) {
+        printf("kill: usage: kill [-s sigspec | -sigspec] pid | jobspec ...\n");
+        return 2;
+    }
+    int status = 0;
+    for (; cmd[i] != NULL; i++) {
+        if (cmd[i][0] == '%') {
+            struct job* j = job_from_arg("kill", cmd[i]);
+            if (j == NULL) {
+                status = 1;
+                continue;
             }
-            if (l->out && cmd[i + 1] == NULL) {
-                close(fd_out);
-                dup2(stdout_copy, 1);
-                close(stdout_copy);
+            kill(-j->pgid, sig);
+            // A stopped job would only handle the signal once continued
+            if (j->state == JOB_STOPPED && sig != SIGSTOP && sig != SIGCONT) {
+                kill(-j->pgid, SIGCONT);
             }
-            printf("Command %s not recognized\n", cmd[i][0]);
-            exit(1);
-        } else {
-            // Wait for the end of child process just created before
-            waitpid(0,0,0);
+        } else if (kill(atoi(cmd[i]), sig) == -1) {
+            printf("kill: (%s) - %s\n", cmd[i], strerror(errno));
+            status = 1;
         }
-        close(tuyau[1]);
-        // Backup the pipe output in order to reuse it for the next command as a standard input
-        fd_in = tuyau[0];
-        to_close = tuyau[0];
     }
+    return status;
 }
 
-void execute(char** cmd, struct cmdline* l, int nb_args) {
-    if (!strcmp(cmd[0], "jobs")) {
-        print_jobc();
+// hash [-r] [-d name...] [name...]: list, clear, forget or prime the PATH cache
+int hash_builtin(char** cmd) {
+    if (cmd[1] == NULL) {
+        path_print(stdout);
+        return 0;
+    }
+    int status = 0;
+    int forget = 0;
+    for (int i = 1; cmd[i] != NULL; i++) {
+        if (!strcmp(cmd[i], "-r")) {
+            path_clear();
+        } else if (!strcmp(cmd[i], "-d")) {
+            forget = 1;
+        } else if (forget) {
+            path_forget(cmd[i]);
+        } else if (path_lookup(cmd[i]) == NULL) {
+            printf("hash: %s: not found\n", cmd[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+int jobs_builtin(char** cmd) {
+    (void)cmd;
+    print_jobs();
+    return 0;
+}
+
+// Commands run by the shell itself, sorted by name for bsearch()
+static const struct builtin {
+    const char* name;
+    int (*run)(char** argv);
+} builtins[] = {
+    {":", true_builtin},
+    {"[", test_builtin},
+    {"affinity", affinity_builtin},
+    {"bg", bg_builtin},
+    {"cd", cd_builtin},
+    {"echo", echo_builtin},
+    {"false", false_builtin},
+    {"fg", fg_builtin},
+    {"hash", hash_builtin},
+    {"history", histfile_builtin},
+    {"joblog", joblog_builtin},
+    {"jobs", jobs_builtin},
+    {"kill", kill_builtin},
+    {"parallel", parallel_builtin},
+    {"pipesize", pipesize_builtin},
+    {"printf", printf_builtin},
+    {"pwd", pwd_builtin},
+    {"stats", stats_builtin},
+    {"tee", tee_builtin},
+    {"test", test_builtin},
+    {"true", true_builtin},
+    {"ulimit", ulimit_builtin},
+    {"wait", wait_builtin},
+};
+
+static int builtin_cmp(const void* name, const void* b) {
+    return strcmp(name, ((const struct builtin*)b)->name);
+}
+
+// Builtin called name, NULL for a command to launch
+static const struct builtin* find_builtin(const char* name) {
+    return bsearch(name, builtins, sizeof(builtins) / sizeof(builtins[0]),
+                   sizeof(builtins[0]), builtin_cmp);
+}
+
+// Connect the standard stream fd to the file path while a builtin runs in
+// the shell. Return a copy of the previous stream, -1 if path cannot be opened.
+static int redirect_builtin(int fd, char* path, int flags) {
+    int f = open(path, flags | O_CLOEXEC, 0644);
+    if (f == -1) {
+        printf("[ERROR] open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    int saved = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    dup2(f, fd);
+    close(f);
+    return saved;
+}
+
+static void restore_builtin(int fd, int saved) {
+    if (saved != -1) {
+        dup2(saved, fd);
+        close(saved);
+    }
+}
+
+// Run a foreground builtin in the shell itself: no fork nor exec
+static void run_builtin(const struct builtin* b, char** cmd, struct cmdline* l) {
+    int saved_in = -1;
+    int saved_out = -1;
+    if (l->in && (saved_in = redirect_builtin(0, l->in, O_RDONLY)) == -1) {
+        last_status = 1;
         return;
     }
+    if (l->out) {
+        fflush(stdout);
+        if ((saved_out = redirect_builtin(1, l->out, O_WRONLY | O_TRUNC | O_CREAT)) == -1) {
+            restore_builtin(0, saved_in);
+            last_status = 1;
+            return;
+        }
+    }
 
-    pid_t pid;
-    if ((pid = fork()) == 0) {
-        int fd_in, fd_out, stdin_copy, stdout_copy;
-        if (l->in) {
-            stdin_copy = dup(0);
-            close(0);
-            // fd_in must be 0
-            fd_in = open(l->in, O_RDONLY);
-            if (fd_in == -1) {
-                perror("[ERROR] open");
-                exit(EXIT_FAILURE);
-            }
+    struct timespec start, end;
+    struct rusage before, after;
+    if (l->time) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        getrusage(RUSAGE_SELF, &before);
+    }
+    uint64_t started = stats_now();
+    last_status = b->run(cmd);
+    stats_add(STAT_BUILTIN, stats_now() - started);
+    fflush(stdout);
+    if (l->time) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        getrusage(RUSAGE_SELF, &after);
+    }
+
+    restore_builtin(1, saved_out);
+    restore_builtin(0, saved_in);
+    if (l->time) {
+        struct job_usage u;
+        u.real = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        u.user = (after.ru_utime.tv_sec - before.ru_utime.tv_sec)
+                 + (after.ru_utime.tv_usec - before.ru_utime.tv_usec) / 1e6;
+        u.sys = (after.ru_stime.tv_sec - before.ru_stime.tv_sec)
+                + (after.ru_stime.tv_usec - before.ru_stime.tv_usec) / 1e6;
+        u.maxrss = after.ru_maxrss;
+        u.nvcsw = after.ru_nvcsw - before.ru_nvcsw;
+        u.nivcsw = after.ru_nivcsw - before.ru_nivcsw;
+        print_usage(&u, l->time);
+    }
+}
+
+// Create the job of the command line and launch all its processes. Return
+// NULL if the pipe options are invalid.
+static struct job* launch_pipeline(struct cmdline* l) {
+    char*** cmd = l->seq;
+    int nb_cmd = 0;
+    while (cmd[nb_cmd] != NULL) {
+        ++nb_cmd;
+    }
+
+    struct pipe_conf conf = pipe_default;
+    if (l->pipesize && pipe_conf_parse(l->pipesize, &conf) == -1) {
+        printf("pipesize: %s: invalid pipe size\n", l->pipesize);
+        last_status = 2;
+        return NULL;
+    }
+    double timeout = 0;
+    if (l->timeout) {
+        char* end;
+        timeout = strtod(l->timeout, &end);
+        if (end == l->timeout || *end != '\0' || !(timeout > 0)) {
+            printf("timeout: %s: invalid duration\n", l->timeout);
+            last_status = 2;
+            return NULL;
         }
-        if (l->out) {
-            stdout_copy = dup(1);
-            close(1);
-            // fd_out must be 1
-            fd_out = open(l->out, O_WRONLY | O_TRUNC | O_CREAT, 0644);
-            if (fd_out == -1) {
-                perror("[ERROR] open");
-                exit(EXIT_FAILURE);
-            }
+    }
+
+    char* text = cmdline_text(l);
+    // The >+ redirection adds a process copying the output to the files
+    struct job* j = job_create(text, nb_cmd + (l->outs != NULL), !l->bg);
+    free(text);
+    j->timed = l->time;
+    int fd_in = -1;
+    // With joblog on, a background job writes to its log and not over the prompt
+    int fd_log = -1;
+    if (l->bg && joblog_size != 0 && (fd_log = joblog_open(j->id)) == -1) {
+        perror("[ERROR] joblog");
+    }
+    // The replicas of a |N stage get a CPU each
+    int nb_slots = 0;
+    for (int i = 0; i < nb_cmd; i++) {
+        nb_slots += l->stages[i].shards;
+    }
+    int placement = placement_start(nb_slots);
+    int slot = 0;
+
+    // Launch every stage up front: all of them run concurrently
+    for (int i = 0; i < nb_cmd; i++) {
+        int tuyau[2] = {-1, -1};
+        int last = (cmd[i + 1] == NULL);
+        if ((!last || l->outs) && pipe_open(tuyau, &conf) == -1) {
+            perror("[ERROR] pipe");
+            break;
+        }
+
+        struct launch p;
+        launch_init(&p, cmd[i]);
+        p.pgid = j->pgid;
+        p.foreground = j->foreground;
+        placement_set(&p, placement, slot, l->stages[i].shards);
+        slot += l->stages[i].shards;
+        if (i == 0) {
+            p.in = l->in;
         }
-        execvp(cmd[0], cmd);
-        if (l->in) {
+        p.fd_in = fd_in;
+        p.fd_err = fd_log;
+        if (last && !l->outs) {
+            p.out = l->out;
+            p.fd_out = fd_log;
+        } else {
+            // Connect the standard output to the input of the next pipe
+            p.fd_out = tuyau[1];
+        }
+
+        // A builtin stage runs in a forked copy of the shell, without exec
+        const struct builtin* b = find_builtin(cmd[i][0]);
+        pid_t pid;
+        uint64_t start = stats_now();
+        if (l->stages[i].shards > 1) {
+            pid = shard_launch(&p, l->stages[i].shards, l->stages[i].ordered);
+        } else {
+            pid = b ? launch_function(&p, b->run) : launch(&p);
+        }
+        stats_add(b || l->stages[i].shards > 1 ? STAT_FORK : STAT_SPAWN, stats_now() - start);
+        if (pid == -1) {
+            report_launch_error(&p);
+        } else {
+            job_add_process(j, pid);
+        }
+
+        // The parent keeps no pipe end: only the next stage reads tuyau[0]
+        if (fd_in != -1) {
             close(fd_in);
-            dup2(stdin_copy, 0);
-            close(stdin_copy);
         }
-        if (l->out) {
-            close(fd_out);
-            dup2(stdout_copy, 1);
-            close(stdout_copy);
+        if (tuyau[1] != -1) {
+            close(tuyau[1]);
         }
-        printf("\nCommand %s not recognized\n", cmd[0]);
+        fd_in = tuyau[0];
+    }
+
+    if (l->outs && fd_in != -1) {
+        // The files are written by splice() in a forked copy of the shell
+        struct launch p;
+        launch_init(&p, l->outs);
+        p.pgid = j->pgid;
+        p.fd_in = fd_in;
+        p.fd_err = fd_log;
+        pid_t pid = launch_function(&p, fanout_files);
+        if (pid == -1) {
+            perror("[ERROR] fork");
+        } else {
+            job_add_process(j, pid);
+        }
+    }
+    if (fd_in != -1) {
+        close(fd_in);
+    }
+    if (fd_log != -1) {
+        close(fd_log);
+    }
+    if (timeout > 0 && j->nb_procs > 0 && job_set_timeout(j, timeout) == -1) {
+        perror("[ERROR] timerfd");
+    }
+    return j;
+}
+
+void exec_pipe(struct cmdline* l) {
+    struct job* j = launch_pipeline(l);
+    if (j != NULL) {
+        // Reap all the stages together
+        start_job(j);
+    }
+}
+
+void execute(char** cmd, struct cmdline* l, int nb_args) {
+    const struct builtin* b = find_builtin(cmd[0]);
+    // A builtin with a timeout runs in a process which can be killed
+    if (b != NULL && !l->bg && !l->outs && !l->timeout) {
+        run_builtin(b, cmd, l);
         return;
     }
-    else {
-        if (!l->bg) {
-            // Wait for the end of the child process just created before
-            wait(NULL);
+    // Launched as a pipeline of one command: a builtin in background runs in
+    // a forked copy of the shell, the >+ redirection adds a second process
+    exec_pipe(l);
+}
+
+#if USE_GUILE == 1
+// Command line of the shell syntax, kept for the scripts using executer
+int question6_executer(char* line) {
+    /* parsecmd free line and set it up to 0 */
+    struct cmdline* l = parsecmd(&line);
+    if (l == NULL) {
+        return last_status;
+    }
+    if (l->err) {
+        printf("error: %s\n", l->err);
+        return 2;
+    }
+    if (l->seq[0] != NULL && (l->seq[1] != NULL || l->outs)) {
+        exec_pipe(l);
+    } else if (l->seq[0] != NULL) {
+        execute(l->seq[0], l, 0);
+    }
+    return last_status;
+}
+
+SCM executer_wrapper(SCM x) {
+    return scm_from_int(question6_executer(scm_to_locale_string(x)));
+}
+
+#if USE_GUILE_JOBS == 1
+/*
+ * Scheme interface. The commands are given as lists of strings and run
+ * without going through parsecmd:
+ *   (run '("ls" "-l") #:out "f")          => ((status . 0) (real . 0.01) ...)
+ *   (pipeline '("ls") '("wc" "-l") #:in "f")
+ *   (spawn-async '("sleep" "10"))         => job number, see (wait-job N)
+ * Not built by default (cmake -DGUILE_JOBS=ON): it has not been compiled
+ * against a libguile yet.
+ */
+
+static SCM kw_in;
+static SCM kw_out;
+
+// Null terminated argv of the Scheme list of strings, freed with the
+// current dynwind context
+static char** scheme_argv(const char* subr, SCM list) {
+    long n = scm_ilength(list);
+    if (n <= 0) {
+        scm_misc_error(subr, "a command is a non empty list of strings: ~S", scm_list_1(list));
+    }
+    char** argv = malloc((n + 1) * sizeof(char*));
+    scm_dynwind_free(argv);
+    for (long i = 0; i < n; i++, list = scm_cdr(list)) {
+        argv[i] = scm_to_locale_string(scm_car(list));
+        scm_dynwind_free(argv[i]);
+    }
+    argv[n] = NULL;
+    return argv;
+}
+
+// Fill l with the commands of args, lists of strings followed by the
+// #:in and #:out keywords. Freed with the current dynwind context.
+static void scheme_cmdline(const char* subr, SCM args, struct cmdline* l) {
+    long nb_cmd = 0;
+    SCM rest = args;
+    while (scm_is_pair(rest) && !scm_is_keyword(scm_car(rest))) {
+        nb_cmd++;
+        rest = scm_cdr(rest);
+    }
+    if (nb_cmd == 0) {
+        scm_misc_error(subr, "no command", SCM_EOL);
+    }
+    SCM in = SCM_UNDEFINED;
+    SCM out = SCM_UNDEFINED;
+    scm_c_bind_keyword_arguments(subr, rest, 0, kw_in, &in, kw_out, &out, SCM_UNDEFINED);
+
+    memset(l, 0, sizeof(*l));
+    l->seq = malloc((nb_cmd + 1) * sizeof(char**));
+    scm_dynwind_free(l->seq);
+    l->stages = malloc(nb_cmd * sizeof(struct stage));
+    scm_dynwind_free(l->stages);
+    for (long i = 0; i < nb_cmd; i++, args = scm_cdr(args)) {
+        l->seq[i] = scheme_argv(subr, scm_car(args));
+        l->stages[i].shards = 1;
+        l->stages[i].ordered = 0;
+    }
+    l->seq[nb_cmd] = NULL;
+    if (!SCM_UNBNDP(in)) {
+        l->in = scm_to_locale_string(in);
+        scm_dynwind_free(l->in);
+    }
+    if (!SCM_UNBNDP(out)) {
+        l->out = scm_to_locale_string(out);
+        scm_dynwind_free(l->out);
+    }
+}
+
+// Exit status and resources of an ended job, as an association list
+static SCM scheme_result(int status, struct job_usage* u) {
+    return scm_list_n(scm_cons(scm_from_utf8_symbol("status"), scm_from_int(status)),
+                      scm_cons(scm_from_utf8_symbol("real"), scm_from_double(u->real)),
+                      scm_cons(scm_from_utf8_symbol("user"), scm_from_double(u->user)),
+                      scm_cons(scm_from_utf8_symbol("sys"), scm_from_double(u->sys)),
+                      scm_cons(scm_from_utf8_symbol("maxrss"), scm_from_long(u->maxrss)),
+                      scm_cons(scm_from_utf8_symbol("nvcsw"), scm_from_long(u->nvcsw)),
+                      scm_cons(scm_from_utf8_symbol("nivcsw"), scm_from_long(u->nivcsw)),
+                      SCM_UNDEFINED);
+}
+
+// Launch the commands of args. In foreground return the result of the job,
+// #f if it was stopped; in background return its number.
+static SCM scheme_launch(const char* subr, SCM args, int background) {
+    struct cmdline l;
+    SCM result = SCM_BOOL_F;
+
+    scm_dynwind_begin(0);
+    scheme_cmdline(subr, args, &l);
+    l.bg = background;
+    struct job* j = launch_pipeline(&l);
+    if (j == NULL || j->nb_procs == 0) {
+        if (j != NULL) {
+            job_remove(j);
         }
-        else {
-            push_jobc(cmd, pid, nb_args);
+    } else if (background) {
+        printf("[%d] %d\n", j->id, j->pgid);
+        result = scm_from_int(j->id);
+    } else {
+        struct job_usage u;
+        if (run_foreground(j, &u)) {
+            result = scheme_result(last_status, &u);
         }
     }
+    scm_dynwind_end();
+    return result;
 }
 
-void signal_handler(int sig) {
-    // Reap zombies
-    pid_t pid;
-    int status;
-    while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        struct jobc* j = search_jobc(pid);
-        if (j == NULL) {
-            continue;
-        }
-        printf("\nLe fils [%d: ", pid);
-        for (int i = 0; j->cmd[i] != NULL; i++) {
-            printf("%s ", j->cmd[i]);
+SCM scheme_run(SCM argv, SCM rest) {
+    return scheme_launch("run", scm_cons(argv, rest), 0);
+}
+
+SCM scheme_pipeline(SCM args) {
+    return scheme_launch("pipeline", args, 0);
+}
+
+SCM scheme_spawn_async(SCM args) {
+    return scheme_launch("spawn-async", args, 1);
+}
+
+// Wait for a job of spawn-async and return its result, #f if the job does
+// not exist anymore (already reported before a prompt) or was stopped
+SCM scheme_wait_job(SCM id) {
+    struct job* j = job_by_id(scm_to_int(id));
+    if (j == NULL || j->foreground) {
+        return SCM_BOOL_F;
+    }
+    wait_job(j);
+    if (j->state != JOB_DONE) {
+        return SCM_BOOL_F;
+    }
+    int status = j->status[j->nb_procs - 1];
+    struct job_usage u;
+    job_usage(j, -1, &u);
+    job_remove(j);
+    return scheme_result(WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status), &u);
+}
+#endif
+
+// Guile is brought up by the first Scheme line only: most sessions and
+// scripts have none, and its initialisation dominates the startup time
+static void guile_init(void) {
+    static int ready = 0;
+    if (!ready) {
+        scm_init_guile();
+        /* register "executer" function in scheme */
+        scm_c_define_gsubr("executer", 1, 0, 0, executer_wrapper);
+#if USE_GUILE_JOBS == 1
+        kw_in = scm_from_utf8_keyword("in");
+        kw_out = scm_from_utf8_keyword("out");
+        scm_c_define_gsubr("run", 1, 0, 1, scheme_run);
+        scm_c_define_gsubr("pipeline", 0, 0, 1, scheme_pipeline);
+        scm_c_define_gsubr("spawn-async", 0, 0, 1, scheme_spawn_async);
+        scm_c_define_gsubr("wait-job", 1, 0, 0, scheme_wait_job);
+#endif
+        ready = 1;
+    }
+}
+
+static SCM eval_line(void* line) {
+    return scm_c_eval_string(line);
+}
+
+static SCM eval_line_error(void* data, SCM key, SCM args) {
+    (void)data;
+    (void)key;
+    (void)args;
+    scm_puts("mauvaise expression/bug en scheme\n", scm_current_output_port());
+    return SCM_UNSPECIFIED;
+}
+#endif
+
+#if USE_GNU_READLINE == 1
+static char* read_line_result;
+static int read_line_done;
+
+static void read_line_handler(char* line) {
+    read_line_result = line;
+    read_line_done = 1;
+    rl_callback_handler_remove();
+}
+#endif
+
+/* Read a command line while handling the events (end of children) */
+char* read_line(char* prompt) {
+    // Report the background jobs which ended since the previous prompt
+    events_reap();
+    notify_jobs();
+#if USE_GNU_READLINE == 1
+    read_line_result = NULL;
+    read_line_done = 0;
+    rl_callback_handler_install(prompt, read_line_handler);
+    while (!read_line_done) {
+        if (events_poll(0, -1)) {
+            rl_callback_read_char();
         }
-        printf("\b] est terminé\n");
-        // Process pid has ended, remove it from jobs list
-        remove_jobc(pid);
     }
+    return read_line_result;
+#else
+    return readline(prompt);
+#endif
 }
 
-int main() {
-    signal(SIGCHLD, signal_handler);
-    printf("Variante %d: %s\n", VARIANTE, VARIANTE_STRING);
+#if USE_GNU_READLINE == 1
+// Line of the history file, for the arrow keys and Ctrl-R
+static void load_history_line(const char* line, size_t len) {
+    char* copy = strndup(line, len);
+    add_history(copy);
+    free(copy);
+}
+#endif
 
-#if USE_GUILE == 1
-    scm_init_guile();
-    /* register "executer" function in scheme */
-    scm_c_define_gsubr("executer", 1, 0, 0, executer_wrapper);
+// Next line of a batch script, after the report of the ended jobs. The
+// pending events are handled too: without them the jobs writing to their
+// log would block on the full pipe until the next foreground command.
+static char* read_script_line(struct script* s) {
+    events_poll(-1, 0);
+    events_reap();
+    notify_jobs();
+    return script_read_line(s);
+}
+
+int main(int argc, char** argv) {
+    while (argc > 1 && !strncmp(argv[1], "--", 2)) {
+        if (!strcmp(argv[1], "--spawn-server")) {
+            // Forked while the shell is small: before Guile and any command
+            if (spawn_server_start() == -1) {
+                perror("ensishell: spawn server");
+            }
+        } else if (!strcmp(argv[1], "--record") && argc > 2) {
+            if (record_open(argv[2]) == -1) {
+                fprintf(stderr, "ensishell: %s: %s\n", argv[2], strerror(errno));
+                exit(2);
+            }
+            argc--;
+            argv++;
+        } else {
+            fprintf(stderr, "ensishell: %s: invalid option\n", argv[1]);
+            exit(2);
+        }
+        argc--;
+        argv++;
+    }
+    if (argc > 1 && !strcmp(argv[1], "-c")) {
+        if (argc < 3) {
+            fprintf(stderr, "ensishell: -c: option requires an argument\n");
+            exit(2);
+        }
+        script = script_from_string(argv[2]);
+    } else if (argc > 1) {
+        script = script_open(argv[1]);
+        if (script == NULL) {
+            fprintf(stderr, "ensishell: %s: %s\n", argv[1], strerror(errno));
+            exit(127);
+        }
+    }
+    batch = (script != NULL);
+
+    // Before Guile creates its threads (first Scheme line), which would get
+    // SIGCHLD otherwise
+    events_init(job_child_status);
+    // The shell hands the terminal over to foreground jobs and takes it back,
+    // Ctrl-Z stops the foreground job only
+    signal(SIGTTOU, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+#if USE_GNU_READLINE == 1
+    // Bracketed paste escapes would end up in front of the command outputs
+    rl_variable_bind("enable-bracketed-paste", "off");
+    // The oldest lines go, the history of a shell up for weeks would grow
+    // with every command otherwise
+    stifle_history(HISTORY_SIZE);
+#endif
+    if (!batch) {
+        printf("Variante %d: %s\n", VARIANTE, VARIANTE_STRING);
+        // Only the last lines of the shared history are read
+        if (histfile_open() == 0) {
+#if USE_GNU_READLINE == 1
+            histfile_recent(HISTORY_SIZE, load_history_line);
 #endif
+        }
+    }
 
     while (1) {
         struct cmdline* l;
@@ -305,34 +1033,50 @@ int main() {
         int j;
         char* prompt = "ensishell>";
 
-        /* Readline use some internal memory structure that
-           can not be cleaned at the end of the program. Thus
-           one memory leak per command seems unavoidable yet */
-        line = readline(prompt);
+        /* The line belongs to the loop until parsecmd() frees it, the
+           command line to the arena of parsecmd() until the next call,
+           the jobs to the job table until they are reported: nothing
+           is left behind by a command */
+        // The previous line is done
+        record_end(last_status);
+        uint64_t start = stats_now();
+        line = batch ? read_script_line(script) : read_line(prompt);
+        stats_add(STAT_READ, stats_now() - start);
+        if (line) {
+            record_line(line);
+        }
         if (line == 0 || !strncmp(line, "exit", 4)) {
             terminate(line);
         }
 
+        if (batch && line[0] == '#') {
+            // Comment, or the #! line of an executable script
+            free(line);
+            continue;
+        }
+
+        if (!batch) {
 #if USE_GNU_READLINE == 1
-        add_history(line);
+            add_history(line);
 #endif
+            histfile_add(line);
+        }
 
 #if USE_GUILE == 1
         /* The line is a scheme command */
         if (line[0] == '(') {
-            char catchligne[strlen(line) + 256];
-            sprintf(catchligne,
-                "(catch #t (lambda () %s) (lambda (key . parameters) "
-                "(display \"mauvaise expression/bug en scheme\n\")))",
-                line);
-            scm_eval_string(scm_from_locale_string(catchligne));
+            guile_init();
+            // Caught in C: no wrapper to build and read for every line
+            scm_internal_catch(SCM_BOOL_T, eval_line, line, eval_line_error, NULL);
             free(line);
             continue;
         }
 #endif
 
         /* parsecmd free line and set it up to 0 */
+        start = stats_now();
         l = parsecmd(&line);
+        stats_add(STAT_PARSE, stats_now() - start);
 
         /* If input stream closed, normal termination */
         if (!l) {
@@ -345,9 +1089,18 @@ int main() {
             continue;
         }
 
-        if (l->in) printf("in: %s\n", l->in);
-        if (l->out) printf("out: %s\n", l->out);
-        if (l->bg) printf("background (&)\n");
+        if (!batch) {
+            if (l->in) printf("in: %s\n", l->in);
+            if (l->out) printf("out: %s\n", l->out);
+            for (int i = 0; l->outs && l->outs[i]; i++) printf("out: %s\n", l->outs[i]);
+            if (l->bg) printf("background (&)\n");
+        }
+
+        if (l->time && l->seq[0] == NULL) {
+            // time alone measures nothing
+            struct job_usage u = {0};
+            print_usage(&u, l->time);
+        }
 
         if (l->seq[0] != NULL) {
             if (l->seq[1] != NULL) {
@@ -358,13 +1111,19 @@ int main() {
                 // If it is a unique command
                 int nb_args = 0;
                 char** cmd = l->seq[0];
-                printf("seq[0]: ");
+                if (!batch) {
+                    printf("seq[0]: ");
+                }
                 for (j = 0; cmd[j] != 0; j++) {
-                    printf("'%s' ", cmd[j]);
+                    if (!batch) {
+                        printf("'%s' ", cmd[j]);
+                    }
                     ++nb_args;
                 }
                 execute(cmd, l, nb_args);
-                printf("\n");
+                if (!batch) {
+                    printf("\n");
+                }
             }
         }
     }
@@ -0,0 +1,125 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
+#include "events.h"
+
+struct watch {
+    int fd;
+    fd_handler cb;
+    void* data;
+};
+
+static int sfd = -1;
+static pid_t owner = 0;     // Process which created sfd
+static child_handler on_child = NULL;
+static struct watch* watches = NULL;
+static int nb_watches = 0, max_watches = 0;
+
+void events_init(child_handler handler) {
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+
+    sfd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd == -1) {
+        perror("[ERROR] signalfd");
+        exit(EXIT_FAILURE);
+    }
+    owner = getpid();
+    on_child = handler;
+}
+
+// A builtin run in a forked copy of the shell (launch_function) has neither
+// the signalfd nor the blocked SIGCHLD of the shell: it gets its own ones.
+// The children which ended before are reaped, their SIGCHLD is lost.
+static void events_check_fork(void) {
+    if (owner != 0 && getpid() != owner) {
+        nb_watches = 0;
+        events_init(on_child);
+        events_reap();
+    }
+}
+
+void events_watch(int fd, fd_handler cb, void* data) {
+    events_check_fork();
+    if (nb_watches == max_watches) {
+        max_watches = max_watches ? 2 * max_watches : 8;
+        watches = realloc(watches, max_watches * sizeof(struct watch));
+    }
+    watches[nb_watches].fd = fd;
+    watches[nb_watches].cb = cb;
+    watches[nb_watches].data = data;
+    nb_watches++;
+}
+
+void events_unwatch(int fd) {
+    for (int i = 0; i < nb_watches; i++) {
+        if (watches[i].fd == fd) {
+            watches[i] = watches[--nb_watches];
+            return;
+        }
+    }
+}
+
+void events_reap(void) {
+    pid_t pid;
+    int status;
+    struct rusage ru;
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &ru)) > 0) {
+        if (on_child) {
+            on_child(pid, status, &ru);
+        }
+    }
+}
+
+int events_poll(int fd, int timeout) {
+    events_check_fork();
+    int nb = nb_watches;
+    struct pollfd fds[nb + 2];
+
+    fds[0].fd = sfd;
+    fds[0].events = POLLIN;
+    fds[1].fd = fd;
+    fds[1].events = POLLIN;
+    for (int i = 0; i < nb; i++) {
+        fds[i + 2].fd = watches[i].fd;
+        fds[i + 2].events = POLLIN;
+    }
+
+    if (poll(fds, nb + 2, timeout) <= 0) {
+        return 0;
+    }
+
+    if (fds[0].revents & POLLIN) {
+        // Several SIGCHLD may be merged in one: drain, then reap everything
+        struct signalfd_siginfo info;
+        while (read(sfd, &info, sizeof(info)) > 0) {
+        }
+        events_reap();
+    }
+    // A handler may unwatch descriptors: look them up again
+    for (int i = 0; i < nb; i++) {
+        if (fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) {
+            for (int j = 0; j < nb_watches; j++) {
+                if (watches[j].fd == fds[i + 2].fd) {
+                    watches[j].cb(watches[j].fd, watches[j].data);
+                    break;
+                }
+            }
+        }
+    }
+    return fd != -1 && (fds[1].revents & (POLLIN | POLLHUP | POLLERR));
+}
@@ -0,0 +1,42 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __EVENTS_H
+#define __EVENTS_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/*
+ * Event loop of the shell. SIGCHLD is blocked and read from a signalfd,
+ * so children are reaped by the main loop and never in signal context.
+ */
+
+/* Called for each reaped, stopped or continued child with its wait4()
+   status and resource usage */
+typedef void (*child_handler)(pid_t pid, int status, struct rusage* ru);
+
+/* Called when a watched file descriptor is readable */
+typedef void (*fd_handler)(int fd, void* data);
+
+/* Block SIGCHLD and create the signalfd. Must be called before any thread
+   is created (Guile), otherwise a thread could consume SIGCHLD.
+   A forked copy of the shell creates its own signalfd on first use. */
+void events_init(child_handler on_child);
+
+/* Call cb(fd, data) each time fd is readable */
+void events_watch(int fd, fd_handler cb, void* data);
+
+/* Stop watching fd */
+void events_unwatch(int fd);
+
+/* Wait at most timeout ms (-1: no limit) for events and handle them.
+   If fd is not -1, it is polled too: return 1 if it is readable, 0 otherwise. */
+int events_poll(int fd, int timeout);
+
+/* Reap the children which have already ended (or stopped), without waiting */
+void events_reap(void);
+
+#endif
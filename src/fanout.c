@@ -0,0 +1,202 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "fanout.h"
+
+#define FANOUT_CHUNK (1024 * 1024)  // Most bytes duplicated at once
+#define FANOUT_COPY (64 * 1024)     // Buffer of the read and write fallback
+
+static int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Move n bytes from the pipe from to the descriptor to with splice(), or
+// read and write once *copy is set (when to does not support splice)
+static int move(int from, int to, size_t n, int* copy) {
+    char buf[FANOUT_COPY];
+    while (n > 0) {
+        ssize_t m;
+        if (!*copy) {
+            m = splice(from, NULL, to, NULL, n, SPLICE_F_MOVE);
+            if (m == -1 && errno == EINVAL) {
+                *copy = 1;
+                continue;
+            }
+        } else {
+            m = read(from, buf, n < sizeof(buf) ? n : sizeof(buf));
+            if (m > 0 && write_all(to, buf, m) == -1) {
+                return -1;
+            }
+        }
+        if (m == -1 && errno == EINTR) {
+            continue;
+        }
+        if (m <= 0) {
+            return -1;
+        }
+        n -= m;
+    }
+    return 0;
+}
+
+// Fallback when in is not a pipe
+static int fanout_copy(int in, int* outs, int nb_outs) {
+    char buf[FANOUT_COPY];
+    while (1) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n;
+        }
+        for (int i = 0; i < nb_outs; i++) {
+            if (write_all(outs[i], buf, n) == -1) {
+                return -1;
+            }
+        }
+    }
+}
+
+int fanout(int in, int* outs, int nb_outs) {
+    struct stat st;
+    if (fstat(in, &st) == -1 || !S_ISFIFO(st.st_mode)) {
+        return fanout_copy(in, outs, nb_outs);
+    }
+
+    // Each output but the last gets a copy of the data in its own pipe,
+    // as big as in so that tee() always duplicates all it is asked to.
+    // The last one consumes the data of in.
+    int tuyaux[nb_outs][2];
+    int copy[nb_outs];
+    int size = fcntl(in, F_GETPIPE_SZ);
+    int status = 0;
+    for (int i = 0; i < nb_outs - 1; i++) {
+        if (pipe2(tuyaux[i], O_CLOEXEC) == -1) {
+            for (int k = 0; k < i; k++) {
+                close(tuyaux[k][0]);
+                close(tuyaux[k][1]);
+            }
+            return -1;
+        }
+        if (size > 0) {
+            fcntl(tuyaux[i][1], F_SETPIPE_SZ, size);
+        }
+    }
+    memset(copy, 0, sizeof(copy));
+
+    while (1) {
+        ssize_t n;
+        if (nb_outs > 1) {
+            n = tee(in, tuyaux[0][1], FANOUT_CHUNK, 0);
+        } else {
+            n = splice(in, NULL, outs[0], NULL, FANOUT_CHUNK, SPLICE_F_MOVE);
+            if (n == -1 && errno == EINVAL) {
+                // Nothing was consumed yet
+                status = fanout_copy(in, outs, 1);
+                break;
+            }
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            status = n;
+            break;
+        }
+        if (nb_outs == 1) {
+            continue;
+        }
+        for (int i = 1; i < nb_outs - 1 && status == 0; i++) {
+            if (tee(in, tuyaux[i][1], n, 0) != n) {
+                status = -1;
+            }
+        }
+        for (int i = 0; i < nb_outs - 1 && status == 0; i++) {
+            status = move(tuyaux[i][0], outs[i], n, &copy[i]);
+        }
+        if (status == 0) {
+            status = move(in, outs[nb_outs - 1], n, &copy[nb_outs - 1]);
+        }
+        if (status != 0) {
+            break;
+        }
+    }
+
+    int err = errno;
+    for (int i = 0; i < nb_outs - 1; i++) {
+        close(tuyaux[i][0]);
+        close(tuyaux[i][1]);
+    }
+    errno = err;
+    return status;
+}
+
+// Open the files of names, or the ones which can be, in outs. Return their number.
+static int open_outputs(char** names, int append, int* outs, int* status) {
+    int nb = 0;
+    for (int i = 0; names[i] != NULL; i++) {
+        int fd = open(names[i], O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+        if (fd == -1) {
+            fprintf(stderr, "[ERROR] open %s: %s\n", names[i], strerror(errno));
+            *status = 1;
+            continue;
+        }
+        outs[nb++] = fd;
+    }
+    return nb;
+}
+
+// Copy the standard input to the files and, if to_stdout is set, to the standard output
+static int fanout_to(char** names, int append, int to_stdout) {
+    int nb_names = 0;
+    while (names[nb_names] != NULL) {
+        nb_names++;
+    }
+    int outs[nb_names + 1];
+    int status = 0;
+    int nb = open_outputs(names, append, outs, &status);
+    if (to_stdout) {
+        fflush(stdout);
+        outs[nb++] = 1;
+    }
+    if (nb > 0 && fanout(0, outs, nb) == -1) {
+        perror("[ERROR] tee");
+        status = 1;
+    }
+    for (int i = 0; i < nb - to_stdout; i++) {
+        close(outs[i]);
+    }
+    return status;
+}
+
+int tee_builtin(char** argv) {
+    int append = (argv[1] != NULL && !strcmp(argv[1], "-a"));
+    return fanout_to(argv + 1 + append, append, 1);
+}
+
+int fanout_files(char** files) {
+    return fanout_to(files, 0, 0);
+}
@@ -0,0 +1,26 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __FANOUT_H
+#define __FANOUT_H
+
+/* Copy everything read from in to each of the nb_outs descriptors of
+   outs, until the end of in. When in is a pipe the data is duplicated
+   with tee(2) and moved with splice(2), without going through user
+   space; an output splice() cannot write to (a terminal, an O_APPEND
+   file) falls back to read and write.
+   Return 0, or -1 with errno set on a read or write error. */
+int fanout(int in, int* outs, int nb_outs);
+
+/* tee [-a] file...: copy the standard input to the files, truncated (or
+   appended to with -a), and to the standard output */
+int tee_builtin(char** argv);
+
+/* Copy the standard input to the files of the null terminated array
+   files, truncated or created. Run by the helper process of the >+
+   redirection. */
+int fanout_files(char** files);
+
+#endif
@@ -0,0 +1,296 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "histfile.h"
+
+#define CHUNK_SIZE 4096
+#define BLOOM_SHIFT 12
+#define BLOOM_BITS (1 << BLOOM_SHIFT)
+#define HISTFILE_DEFAULT 10
+
+// Index entry of the lines of the history between start and end
+struct chunk {
+    uint64_t start;
+    uint64_t end;       // After the '\n' of the last line of the chunk
+    uint8_t bloom[BLOOM_BITS / 8];
+};
+
+static int text_fd = -1;
+static int index_fd = -1;
+// Mappings of the two files, remapped when the other shells made them grow
+static const char* text = NULL;
+static size_t text_size = 0;
+static size_t text_end = 0;     // After the last '\n': a line being written is not there
+static const struct chunk* chunks = NULL;
+static size_t index_size = 0;
+static size_t nb_chunks = 0;
+
+// Map size bytes of fd in place of the old mapping, NULL if empty or failed
+static const void* remap(int fd, const void* map, size_t old_size, size_t size) {
+    if (map != NULL) {
+        munmap((void*)map, old_size);
+    }
+    if (size == 0) {
+        return NULL;
+    }
+    void* p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void text_map(void) {
+    struct stat st;
+    if (fstat(text_fd, &st) == -1 || (size_t)st.st_size == text_size) {
+        return;
+    }
+    text = remap(text_fd, text, text_size, st.st_size);
+    text_size = text ? st.st_size : 0;
+    const char* nl = text_size ? memrchr(text, '\n', text_size) : NULL;
+    text_end = nl ? nl + 1 - text : 0;
+}
+
+static void index_map(void) {
+    struct stat st;
+    if (fstat(index_fd, &st) == -1 || (size_t)st.st_size == index_size) {
+        return;
+    }
+    chunks = remap(index_fd, chunks, index_size, st.st_size);
+    index_size = chunks ? st.st_size : 0;
+    // A partial entry of a shell which died while writing it is ignored
+    nb_chunks = index_size / sizeof(struct chunk);
+}
+
+// Bit of the 4 bytes at s: the high bits of a multiplicative hash
+static unsigned gram(const char* s) {
+    uint32_t v;
+    memcpy(&v, s, sizeof(v));
+    return (v * 2654435761u) >> (32 - BLOOM_SHIFT);
+}
+
+// Set the bits of the 4-grams of the lines of c, not across line ends
+static void chunk_fill(struct chunk* c) {
+    memset(c->bloom, 0, sizeof(c->bloom));
+    size_t line = c->start;
+    while (line < c->end) {
+        const char* nl = memchr(text + line, '\n', c->end - line);
+        size_t next = nl + 1 - text;
+        for (size_t i = line; i + 4 < next; i++) {
+            unsigned bit = gram(text + i);
+            c->bloom[bit / 8] |= 1 << (bit % 8);
+        }
+        line = next;
+    }
+}
+
+// Index the chunks completed since the last update, by this shell or another.
+// The index stays locked shared until index_done(): no shell truncates it
+// under the reader.
+static void index_update(void) {
+    if (index_fd == -1) {
+        return;
+    }
+    flock(index_fd, LOCK_EX);
+    index_map();
+    text_map();
+    if (nb_chunks > 0 && chunks[nb_chunks - 1].end > text_end) {
+        // The history was truncated: its index goes with it
+        if (ftruncate(index_fd, 0) == 0) {
+            index_map();
+        }
+    }
+    struct chunk c;
+    size_t added = 0;
+    c.start = nb_chunks ? chunks[nb_chunks - 1].end : 0;
+    while (c.start + CHUNK_SIZE < text_end) {
+        // A chunk ends with the line holding its last byte
+        const char* nl = memchr(text + c.start + CHUNK_SIZE - 1, '\n',
+                                text_end - (c.start + CHUNK_SIZE - 1));
+        c.end = nl + 1 - text;
+        chunk_fill(&c);
+        off_t at = (nb_chunks + added) * sizeof(struct chunk);
+        if (pwrite(index_fd, &c, sizeof(c), at) != sizeof(c)) {
+            break;
+        }
+        added++;
+        c.start = c.end;
+    }
+    if (added > 0) {
+        index_map();
+    }
+    flock(index_fd, LOCK_SH);
+}
+
+static void index_done(void) {
+    if (index_fd != -1) {
+        flock(index_fd, LOCK_UN);
+    }
+}
+
+int histfile_open(void) {
+    if (text_fd != -1) {
+        return 0;
+    }
+    const char* path = getenv("ENSISHELL_HISTORY");
+    char* home_path = NULL;
+    if (path == NULL) {
+        const char* home = getenv("HOME");
+        if (home == NULL || asprintf(&home_path, "%s/.ensishell_history", home) == -1) {
+            return -1;
+        }
+        path = home_path;
+    }
+    // ENSISHELL_HISTORY= disables the history file
+    if (*path != '\0') {
+        text_fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    }
+    char* index_path;
+    if (text_fd != -1 && asprintf(&index_path, "%s.idx", path) != -1) {
+        // Without index the searches scan the whole history
+        index_fd = open(index_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        free(index_path);
+    }
+    free(home_path);
+    return text_fd == -1 ? -1 : 0;
+}
+
+void histfile_add(const char* line) {
+    if (text_fd == -1 || line[0] == '\0') {
+        return;
+    }
+    // One write: the lines of the other shells go before or after it
+    struct iovec iov[2] = {{(void*)line, strlen(line)}, {"\n", 1}};
+    if (writev(text_fd, iov, 2) == -1) {
+        perror("history");
+    }
+}
+
+void histfile_recent(int n, void (*fn)(const char* line, size_t len)) {
+    if (text_fd == -1) {
+        return;
+    }
+    text_map();
+    // Back from the end of the mapping: only its tail is read
+    size_t pos = text_end;
+    for (int k = 0; k < n && pos > 0; k++) {
+        const char* nl = pos > 1 ? memrchr(text, '\n', pos - 1) : NULL;
+        pos = nl ? nl + 1 - text : 0;
+    }
+    while (pos < text_end) {
+        const char* nl = memchr(text + pos, '\n', text_end - pos);
+        fn(text + pos, nl - (text + pos));
+        pos = nl + 1 - text;
+    }
+}
+
+// Print the lines between start and end which contain pat, the newest
+// first, while *left is positive
+static void search_lines(size_t start, size_t end, const char* pat, size_t len, int* left) {
+    // Most chunks let through by the index have no match: one pass of
+    // memmem tells, before the line by line search backward
+    if (memmem(text + start, end - start, pat, len) == NULL) {
+        return;
+    }
+    while (end > start && *left > 0) {
+        const char* nl = memrchr(text + start, '\n', end - 1 - start);
+        size_t line = nl ? nl + 1 - text : start;
+        if (memmem(text + line, end - 1 - line, pat, len) != NULL) {
+            fwrite(text + line, 1, end - line, stdout);
+            (*left)--;
+        }
+        end = line;
+    }
+}
+
+// Print the last n lines containing pat, the newest first
+static void search(const char* pat, int n) {
+    index_update();
+    text_map();
+    size_t len = strlen(pat);
+    // The lines after the last chunk are not indexed
+    size_t nb = nb_chunks;
+    size_t indexed = nb ? chunks[nb - 1].end : 0;
+    if (indexed > text_end) {
+        // Stale index, not truncated
+        nb = indexed = 0;
+    }
+    search_lines(indexed, text_end, pat, len, &n);
+
+    // A pattern of less than 4 bytes has no 4-gram: every chunk is scanned
+    unsigned bits[len > 3 ? len - 3 : 1];
+    size_t nb_bits = 0;
+    for (size_t i = 0; i + 3 < len; i++) {
+        bits[nb_bits++] = gram(pat + i);
+    }
+    for (size_t i = nb; i-- > 0 && n > 0;) {
+        size_t b = 0;
+        while (b < nb_bits && (chunks[i].bloom[bits[b] / 8] & (1 << (bits[b] % 8)))) {
+            b++;
+        }
+        if (b == nb_bits) {
+            search_lines(chunks[i].start, chunks[i].end, pat, len, &n);
+        }
+    }
+    index_done();
+}
+
+static void print_line(const char* line, size_t len) {
+    fwrite(line, 1, len, stdout);
+    putchar('\n');
+}
+
+int histfile_builtin(char** argv) {
+    const char* pat = NULL;
+    long n = HISTFILE_DEFAULT;
+    int i = 1;
+    if (argv[i] != NULL && !strcmp(argv[i], "-s") && argv[i + 1] != NULL) {
+        pat = argv[i + 1];
+        i += 2;
+    }
+    if (argv[i] != NULL) {
+        char* end;
+        n = strtol(argv[i], &end, 10);
+        if (end == argv[i] || *end != '\0' || n <= 0 || n > INT32_MAX || argv[i + 1] != NULL) {
+            fprintf(stderr, "history: usage: history [-s TEXT] [N]\n");
+            return 2;
+        }
+    }
+    if (histfile_open() == -1) {
+        fprintf(stderr, "history: no history file\n");
+        return 1;
+    }
+    if (pat != NULL) {
+        search(pat, n);
+    } else {
+        histfile_recent(n, print_line);
+    }
+    fflush(stdout);
+    return 0;
+}
+
+void histfile_close(void) {
+    remap(text_fd, text, text_size, 0);
+    remap(index_fd, chunks, index_size, 0);
+    text = NULL;
+    chunks = NULL;
+    text_size = text_end = index_size = nb_chunks = 0;
+    if (text_fd != -1) {
+        close(text_fd);
+    }
+    if (index_fd != -1) {
+        close(index_fd);
+    }
+    text_fd = index_fd = -1;
+}
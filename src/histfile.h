@@ -0,0 +1,43 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __HISTFILE_H
+#define __HISTFILE_H
+
+#include <stddef.h>
+
+/*
+ * History of the command lines shared by the shells of a user, in the file
+ * named by $ENSISHELL_HISTORY ($HOME/.ensishell_history by default). The
+ * file is only appended to, one whole line per write(2) with O_APPEND, so
+ * that concurrent shells never mix their lines, and it is read through
+ * mmap: nothing is parsed at startup, the last lines come from the tail of
+ * the mapping.
+ *
+ * The searches use an index next to it (FILE.idx): the history is cut in
+ * chunks of about 4 kB at line ends, and the index gives for each chunk a
+ * bitmap of 4096 bits of the 4-grams of its lines, 1/8 of the size of the
+ * history. A search only scans the chunks whose bitmap has every 4-gram
+ * of the pattern. The index is extended under flock(2) by the first search
+ * which finds complete chunks not indexed yet.
+ */
+
+/* Open the history file, if not already. Return -1 if there is none. */
+int histfile_open(void);
+
+/* Append line to the history file */
+void histfile_add(const char* line);
+
+/* Call fn for the last n lines of the history, the oldest first */
+void histfile_recent(int n, void (*fn)(const char* line, size_t len));
+
+/* history [-s TEXT] [N]: the last N lines (10), or the last N containing
+   TEXT, the newest first */
+int histfile_builtin(char** argv);
+
+/* Unmap and close the files */
+void histfile_close(void);
+
+#endif
@@ -0,0 +1,227 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "joblog.h"
+#include "events.h"
+#include "jobs.h"
+
+#define JOBLOG_DEFAULT (256 * 1024)
+#define JOBLOG_MAX (64 * 1024 * 1024)
+
+struct log {
+    int fd;             // Read end of the pipe, -1 once closed
+    size_t size;
+    size_t written;     // Bytes received, the last size ones are in data
+    char data[];
+};
+
+size_t joblog_size = 0;
+
+// logs[id] is the log of job number id, or null
+static struct log** logs = NULL;
+static int nb_logs = 0;
+
+static void log_close(struct log* log) {
+    if (log->fd != -1) {
+        events_unwatch(log->fd);
+        close(log->fd);
+        log->fd = -1;
+    }
+}
+
+// Read what the pipe holds straight into the ring, at most one ring worth
+// per call so that a chatty job cannot hold the shell
+static void log_read(int fd, void* data) {
+    struct log* log = data;
+    size_t got = 0;
+    ssize_t n = 0;
+    while (got < log->size) {
+        size_t pos = log->written % log->size;
+        n = read(fd, log->data + pos, log->size - pos);
+        if (n <= 0) {
+            break;
+        }
+        log->written += n;
+        got += n;
+    }
+    if (n == 0 || (n == -1 && errno != EAGAIN && errno != EINTR)) {
+        // No writer left
+        log_close(log);
+    }
+}
+
+int joblog_open(int id) {
+    if (id >= nb_logs) {
+        int new_nb = nb_logs ? 2 * nb_logs : 16;
+        while (new_nb <= id) {
+            new_nb *= 2;
+        }
+        struct log** new_logs = realloc(logs, new_nb * sizeof(struct log*));
+        if (new_logs == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        logs = new_logs;
+        memset(logs + nb_logs, 0, (new_nb - nb_logs) * sizeof(struct log*));
+        nb_logs = new_nb;
+    }
+    joblog_remove(id);
+    struct log* log = malloc(sizeof(struct log) + joblog_size);
+    if (log == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        free(log);
+        return -1;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    log->fd = fds[0];
+    log->size = joblog_size;
+    log->written = 0;
+    logs[id] = log;
+    events_watch(fds[0], log_read, log);
+    return fds[1];
+}
+
+void joblog_remove(int id) {
+    if (id > 0 && id < nb_logs && logs[id] != NULL) {
+        log_close(logs[id]);
+        free(logs[id]);
+        logs[id] = NULL;
+    }
+}
+
+void joblog_clear(void) {
+    for (int id = 0; id < nb_logs; id++) {
+        if (logs[id] != NULL) {
+            log_close(logs[id]);
+            free(logs[id]);
+        }
+    }
+    free(logs);
+    logs = NULL;
+    nb_logs = 0;
+}
+
+// Print the log of the job designated by arg
+static void log_print(struct log* log, const char* arg) {
+    // What the job wrote since the last turn of the event loop: at most what
+    // the pipe holds, which may be more than one ring worth
+    int left = log->fd != -1 ? fcntl(log->fd, F_GETPIPE_SZ) : 0;
+    while (log->fd != -1 && left > 0) {
+        size_t before = log->written;
+        log_read(log->fd, log);
+        if (log->written == before) {
+            break;
+        }
+        left -= log->written - before;
+    }
+
+    // Oldest part of the log, then the newest one
+    const char* a = log->data;
+    size_t a_len = log->written;
+    const char* b = log->data;
+    size_t b_len = 0;
+    if (log->written > log->size) {
+        size_t pos = log->written % log->size;
+        a = log->data + pos;
+        a_len = log->size - pos;
+        b_len = pos;
+        // The oldest line lost its beginning: skip it
+        const char* nl = memchr(a, '\n', a_len);
+        if (nl != NULL) {
+            a_len -= nl + 1 - a;
+            a = nl + 1;
+        } else if ((nl = memchr(b, '\n', b_len)) != NULL) {
+            a_len = 0;
+            b_len -= nl + 1 - b;
+            b = nl + 1;
+        }
+        fprintf(stderr, "joblog: %s: %zu bytes dropped\n", arg, log->written - a_len - b_len);
+    }
+    fwrite(a, 1, a_len, stdout);
+    fwrite(b, 1, b_len, stdout);
+}
+
+void joblog_report(int id) {
+    if (id > 0 && id < nb_logs && logs[id] != NULL) {
+        char arg[16];
+        snprintf(arg, sizeof(arg), "%%%d", id);
+        log_print(logs[id], arg);
+    }
+}
+
+// SIZE[k|m] in bytes, 0 if invalid or above JOBLOG_MAX
+static size_t parse_size(const char* s) {
+    char* end;
+    long size = strtol(s, &end, 10);
+    int shift = 0;
+    if (end == s || size <= 0) {
+        return 0;
+    }
+    if (*end == 'k' || *end == 'K') {
+        shift = 10;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        shift = 20;
+        end++;
+    }
+    if (*end != '\0' || size > JOBLOG_MAX >> shift) {
+        return 0;
+    }
+    return (size_t)size << shift;
+}
+
+int joblog_builtin(char** argv) {
+    if (argv[1] == NULL) {
+        if (joblog_size == 0) {
+            printf("joblog off\n");
+        } else {
+            printf("joblog on %zu\n", joblog_size);
+        }
+        return 0;
+    }
+    if (!strcmp(argv[1], "off") && argv[2] == NULL) {
+        joblog_size = 0;
+        return 0;
+    }
+    if (!strcmp(argv[1], "on") && (argv[2] == NULL || argv[3] == NULL)) {
+        size_t size = argv[2] ? parse_size(argv[2]) : JOBLOG_DEFAULT;
+        if (size == 0) {
+            fprintf(stderr, "joblog: %s: invalid size (1 to %dm)\n", argv[2], JOBLOG_MAX >> 20);
+            return 1;
+        }
+        joblog_size = size;
+        return 0;
+    }
+    if (argv[1][0] != '%' && (argv[1][0] < '0' || argv[1][0] > '9')) {
+        fprintf(stderr, "joblog: usage: joblog [on [SIZE[k|m]] | off | %%N|pid...]\n");
+        return 2;
+    }
+
+    int status = 0;
+    for (int i = 1; argv[i] != NULL; i++) {
+        struct job* j = argv[i][0] == '%' ? job_from_spec(argv[i]) : job_by_pid(atoi(argv[i]));
+        struct log* log = (j != NULL && j->id < nb_logs) ? logs[j->id] : NULL;
+        if (log == NULL) {
+            printf("joblog: %s: no log\n", argv[i]);
+            status = 1;
+        } else {
+            log_print(log, argv[i]);
+        }
+    }
+    fflush(stdout);
+    return status;
+}
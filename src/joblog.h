@@ -0,0 +1,41 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __JOBLOG_H
+#define __JOBLOG_H
+
+#include <stddef.h>
+
+/*
+ * Output of the background jobs kept in memory. When the capture is on
+ * (joblog on), the standard output and error of a background job go to a
+ * pipe read by the event loop into a ring buffer of joblog_size bytes: the
+ * job does not write over the prompt, and only the tail of what it prints
+ * is kept. That tail is printed with the report of the end of the job,
+ * and the log is freed with the job.
+ */
+
+/* Size of the logs of the next background jobs, 0 when the capture is off */
+extern size_t joblog_size;
+
+/* Start the log of job number id. Return the write end of its pipe
+   (close-on-exec), to close once the processes are launched, or -1 with
+   errno set. */
+int joblog_open(int id);
+
+/* Print the tail of the log of job number id, if it has one */
+void joblog_report(int id);
+
+/* Close and free the log of job number id, if it has one */
+void joblog_remove(int id);
+
+/* Close and free all the logs */
+void joblog_clear(void);
+
+/* joblog [on [SIZE[k|m]] | off]: print or set the capture,
+   joblog %N|pid...: print the tail of the output of the jobs */
+int joblog_builtin(char** argv);
+
+#endif
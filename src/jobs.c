@@ -0,0 +1,346 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+#include "jobs.h"
+#include "events.h"
+#include "joblog.h"
+
+// Slot array: slots[id] is job number id, slots[0] is unused
+static struct job** slots = NULL;
+static int nb_slots = 0;
+static int max_id = 0;
+
+// Open addressing hash table pid -> job, the size is a power of two
+struct pid_entry {
+    pid_t pid;          // 0: free, -1: deleted
+    struct job* job;
+};
+
+static struct pid_entry* pid_table = NULL;
+static size_t pid_size = 0;
+static size_t pid_used = 0;     // Entries and tombstones
+static size_t pid_live = 0;     // Entries
+
+static size_t hash_pid(pid_t pid) {
+    return (size_t)pid * 2654435761u;
+}
+
+static void pid_insert(pid_t pid, struct job* j);
+
+// Rebuild the table without its tombstones, with room for as many entries
+static void pid_rehash(void) {
+    struct pid_entry* old = pid_table;
+    size_t old_size = pid_size;
+
+    pid_size = 64;
+    while (pid_size < 4 * (pid_live + 1)) {
+        pid_size *= 2;
+    }
+    pid_table = calloc(pid_size, sizeof(struct pid_entry));
+    pid_used = 0;
+    pid_live = 0;
+    for (size_t i = 0; i < old_size; i++) {
+        if (old[i].pid > 0) {
+            pid_insert(old[i].pid, old[i].job);
+        }
+    }
+    free(old);
+}
+
+static void pid_insert(pid_t pid, struct job* j) {
+    if (2 * (pid_used + 1) > pid_size) {
+        pid_rehash();
+    }
+    size_t i = hash_pid(pid) & (pid_size - 1);
+    while (pid_table[i].pid > 0) {
+        i = (i + 1) & (pid_size - 1);
+    }
+    if (pid_table[i].pid == 0) {
+        pid_used++;
+    }
+    pid_table[i].pid = pid;
+    pid_table[i].job = j;
+    pid_live++;
+}
+
+static void pid_delete(struct pid_entry* e) {
+    e->pid = -1;
+    pid_live--;
+}
+
+static struct pid_entry* pid_find(pid_t pid) {
+    if (pid_size == 0) {
+        return NULL;
+    }
+    size_t i = hash_pid(pid) & (pid_size - 1);
+    while (pid_table[i].pid != 0) {
+        if (pid_table[i].pid == pid) {
+            return &pid_table[i];
+        }
+        i = (i + 1) & (pid_size - 1);
+    }
+    return NULL;
+}
+
+struct job* job_create(const char* text, int max_procs, int foreground) {
+    struct job* j = malloc(sizeof(struct job));
+    j->id = max_id + 1;
+    j->pgid = 0;
+    j->nb_procs = 0;
+    j->max_procs = max_procs;
+    j->nb_alive = 0;
+    j->pids = calloc(max_procs, sizeof(pid_t));
+    j->status = calloc(max_procs, sizeof(int));
+    j->usage = calloc(max_procs, sizeof(struct rusage));
+    clock_gettime(CLOCK_MONOTONIC, &j->start);
+    j->end = j->start;
+    j->text = strdup(text);
+    j->state = JOB_RUNNING;
+    j->foreground = foreground;
+    j->timed = 0;
+    j->timer = -1;
+    j->timed_out = 0;
+
+    if (j->id >= nb_slots) {
+        int new_nb = nb_slots ? 2 * nb_slots : 16;
+        slots = realloc(slots, new_nb * sizeof(struct job*));
+        memset(slots + nb_slots, 0, (new_nb - nb_slots) * sizeof(struct job*));
+        nb_slots = new_nb;
+    }
+    slots[j->id] = j;
+    max_id = j->id;
+    return j;
+}
+
+void job_add_process(struct job* j, pid_t pid) {
+    if (j->nb_procs == 0) {
+        j->pgid = pid;
+    }
+    j->pids[j->nb_procs++] = pid;
+    j->nb_alive++;
+    pid_insert(pid, j);
+}
+
+void job_remove(struct job* j) {
+    for (int i = 0; i < j->nb_procs; i++) {
+        struct pid_entry* e = j->pids[i] > 0 ? pid_find(j->pids[i]) : NULL;
+        if (e != NULL && e->job == j) {
+            pid_delete(e);
+        }
+    }
+    if (j->timer != -1) {
+        events_unwatch(j->timer);
+        close(j->timer);
+    }
+    joblog_remove(j->id);
+    slots[j->id] = NULL;
+    while (max_id > 0 && slots[max_id] == NULL) {
+        max_id--;
+    }
+    free(j->pids);
+    free(j->status);
+    free(j->usage);
+    free(j->text);
+    free(j);
+}
+
+static void arm_timer(int fd, double seconds) {
+    struct itimerspec t = {{0, 0}, {(time_t)seconds, (seconds - (time_t)seconds) * 1e9}};
+    if (t.it_value.tv_sec == 0 && t.it_value.tv_nsec == 0) {
+        t.it_value.tv_nsec = 1;     // A zero value would disarm the timer
+    }
+    timerfd_settime(fd, 0, &t, NULL);
+}
+
+// The wall clock limit of the job is reached
+static void job_timer(int fd, void* data) {
+    struct job* j = data;
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)
+        || j->state == JOB_DONE) {
+        return;
+    }
+    int sig = j->timed_out++ ? SIGKILL : SIGTERM;
+    kill(-j->pgid, sig);
+    if (j->state == JOB_STOPPED) {
+        kill(-j->pgid, SIGCONT);
+    }
+    if (sig == SIGTERM) {
+        arm_timer(fd, JOB_KILL_DELAY);
+    }
+}
+
+int job_set_timeout(struct job* j, double seconds) {
+    j->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (j->timer == -1) {
+        return -1;
+    }
+    arm_timer(j->timer, seconds);
+    events_watch(j->timer, job_timer, j);
+    return 0;
+}
+
+struct job* job_by_id(int id) {
+    if (id <= 0 || id > max_id) {
+        return NULL;
+    }
+    return slots[id];
+}
+
+struct job* job_by_pid(pid_t pid) {
+    struct pid_entry* e = pid_find(pid);
+    return e ? e->job : NULL;
+}
+
+int job_max_id(void) {
+    return max_id;
+}
+
+// Most recent job not running in foreground, skipping skip of them
+static struct job* recent_job(int skip) {
+    for (int id = max_id; id > 0; id--) {
+        if (slots[id] != NULL && !slots[id]->foreground && skip-- == 0) {
+            return slots[id];
+        }
+    }
+    return NULL;
+}
+
+struct job* job_from_spec(const char* spec) {
+    if (spec[0] != '%') {
+        return NULL;
+    }
+    if (!strcmp(spec, "%%") || !strcmp(spec, "%+") || spec[1] == '\0') {
+        return recent_job(0);
+    }
+    if (!strcmp(spec, "%-")) {
+        return recent_job(1);
+    }
+    char* end;
+    long id = strtol(spec + 1, &end, 10);
+    if (*end != '\0' || id <= 0 || id > max_id) {
+        return NULL;
+    }
+    return slots[id];
+}
+
+void job_child_status(pid_t pid, int status, struct rusage* ru) {
+    struct job* j = job_by_pid(pid);
+    if (j == NULL) {
+        return;
+    }
+    if (WIFSTOPPED(status)) {
+        j->state = JOB_STOPPED;
+        return;
+    }
+    if (WIFCONTINUED(status)) {
+        j->state = JOB_RUNNING;
+        return;
+    }
+    for (int i = 0; i < j->nb_procs; i++) {
+        if (j->pids[i] == pid) {
+            j->status[i] = status;
+            j->usage[i] = *ru;
+            // Reaped: the pid may be reused by a new process
+            j->pids[i] = -pid;
+        }
+    }
+    pid_delete(pid_find(pid));
+    if (--j->nb_alive == 0) {
+        j->state = JOB_DONE;
+        clock_gettime(CLOCK_MONOTONIC, &j->end);
+    }
+}
+
+static double timeval_sec(struct timeval* tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+// Add the usage of the running process pid, read from /proc
+static void proc_usage(pid_t pid, struct job_usage* u) {
+    char path[64], buf[512];
+    FILE* f;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    if ((f = fopen(path, "r")) != NULL) {
+        unsigned long utime, stime;
+        // The command name may contain spaces: the fields start after ')'
+        if (fgets(buf, sizeof(buf), f) != NULL && strrchr(buf, ')') != NULL
+            && sscanf(strrchr(buf, ')') + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                      &utime, &stime) == 2) {
+            long ticks = sysconf(_SC_CLK_TCK);
+            u->user += (double)utime / ticks;
+            u->sys += (double)stime / ticks;
+        }
+        fclose(f);
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    if ((f = fopen(path, "r")) != NULL) {
+        long value;
+        while (fgets(buf, sizeof(buf), f) != NULL) {
+            if (sscanf(buf, "VmHWM: %ld", &value) == 1 && value > u->maxrss) {
+                u->maxrss = value;
+            } else if (sscanf(buf, "voluntary_ctxt_switches: %ld", &value) == 1) {
+                u->nvcsw += value;
+            } else if (sscanf(buf, "nonvoluntary_ctxt_switches: %ld", &value) == 1) {
+                u->nivcsw += value;
+            }
+        }
+        fclose(f);
+    }
+}
+
+void job_usage(struct job* j, int stage, struct job_usage* u) {
+    struct timespec end = j->end;
+    if (j->state != JOB_DONE) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+    }
+    memset(u, 0, sizeof(*u));
+    u->real = (end.tv_sec - j->start.tv_sec) + (end.tv_nsec - j->start.tv_nsec) / 1e9;
+
+    for (int i = 0; i < j->nb_procs; i++) {
+        if (stage != -1 && i != stage) {
+            continue;
+        }
+        if (j->pids[i] > 0) {
+            proc_usage(j->pids[i], u);
+            continue;
+        }
+        struct rusage* ru = &j->usage[i];
+        u->user += timeval_sec(&ru->ru_utime);
+        u->sys += timeval_sec(&ru->ru_stime);
+        if (ru->ru_maxrss > u->maxrss) {
+            u->maxrss = ru->ru_maxrss;
+        }
+        u->nvcsw += ru->ru_nvcsw;
+        u->nivcsw += ru->ru_nivcsw;
+    }
+}
+
+void jobs_clear(void) {
+    for (int id = max_id; id > 0; id--) {
+        if (slots[id] != NULL) {
+            job_remove(slots[id]);
+        }
+    }
+    free(slots);
+    slots = NULL;
+    nb_slots = 0;
+    free(pid_table);
+    pid_table = NULL;
+    pid_size = 0;
+    pid_used = 0;
+    pid_live = 0;
+}
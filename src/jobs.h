@@ -0,0 +1,96 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __JOBS_H
+#define __JOBS_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/*
+ * Job table. A job is a command line (a pipeline of processes sharing a
+ * process group), numbered from 1 like the %N job specs. Jobs are stored
+ * in a slot array indexed by their number, and a hash table maps the pid
+ * of each process to its job.
+ */
+
+enum job_state {
+    JOB_RUNNING,
+    JOB_STOPPED,
+    JOB_DONE,
+};
+
+struct job {
+    int id;             /* Job number, index in the slot array */
+    pid_t pgid;         /* Process group of all the processes, 0 until launched */
+    int nb_procs;       /* Number of processes launched */
+    int max_procs;      /* Room in pids and status */
+    int nb_alive;       /* Processes not reaped yet */
+    pid_t* pids;        /* Negated once the process is reaped */
+    int* status;        /* waitpid() status of each process once reaped */
+    struct rusage* usage;   /* Resources used by each process once reaped */
+    struct timespec start;  /* Creation of the job */
+    struct timespec end;    /* Reaping of its last process */
+    char* text;         /* Command line, owned by the job */
+    enum job_state state;
+    int foreground;
+    int timed;          /* Report its resource usage when done (time prefix) */
+    int timer;          /* timerfd of its wall clock limit, -1 if none */
+    int timed_out;      /* Signals sent at the limit: 1 SIGTERM, 2 SIGKILL */
+};
+
+/* Resources used by processes */
+struct job_usage {
+    double real;        /* Wall clock time, in seconds */
+    double user;        /* CPU time, in seconds */
+    double sys;
+    long maxrss;        /* Maximum resident set size, in kB */
+    long nvcsw;         /* Voluntary and involuntary context switches */
+    long nivcsw;
+};
+
+/* Create a job for a command line of at most max_procs processes.
+   text is copied. */
+struct job* job_create(const char* text, int max_procs, int foreground);
+
+/* Add a launched process to the job, the first one gives the process group */
+void job_add_process(struct job* j, pid_t pid);
+
+/* Send SIGTERM to the process group of the job once it has run for
+   seconds, then SIGKILL JOB_KILL_DELAY seconds later if it is still there.
+   The timer is handled by the event loop. Return -1 if it cannot be created. */
+int job_set_timeout(struct job* j, double seconds);
+
+#define JOB_KILL_DELAY 2
+
+/* Remove the job from the table and free it */
+void job_remove(struct job* j);
+
+/* Job number id, or NULL */
+struct job* job_by_id(int id);
+
+/* Job of process pid, or NULL */
+struct job* job_by_pid(pid_t pid);
+
+/* Job designated by spec: %N, %% or %+ (current job), %- (previous job).
+   Return NULL if there is no such job. */
+struct job* job_from_spec(const char* spec);
+
+/* Highest job number in use, 0 if the table is empty */
+int job_max_id(void);
+
+/* Record the status of a reaped (or stopped/continued) child */
+void job_child_status(pid_t pid, int status, struct rusage* ru);
+
+/* Resources used so far by the process number stage of the job, or by
+   all its processes if stage is -1. The processes still running are
+   sampled from /proc. */
+void job_usage(struct job* j, int stage, struct job_usage* u);
+
+/* Remove all the jobs */
+void jobs_clear(void);
+
+#endif
@@ -0,0 +1,324 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "launcher.h"
+#include "pathcache.h"
+#include "spawnsrv.h"
+
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 34)
+#define HAVE_CLOSEFROM 1
+#endif
+#endif
+
+// From numaif.h, which comes with libnuma
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT 0
+#define MPOL_PREFERRED 1
+#endif
+
+extern char** environ;
+
+long launch_cpu_limit = 0;
+
+void launch_init(struct launch* p, char** argv) {
+    p->argv = argv;
+    p->in = NULL;
+    p->out = NULL;
+    p->fd_in = -1;
+    p->fd_out = -1;
+    p->fd_err = -1;
+    p->pgid = 0;
+    p->foreground = 0;
+    p->cpu_limit = launch_cpu_limit;
+    p->cpus = NULL;
+    p->mem_node = -1;
+    p->failed = NULL;
+}
+
+// Prefer the NUMA node for the memory of the calling thread, and of the
+// processes it creates: the policy is kept across exec. -1 for the default.
+static void set_mem_node(int node) {
+#ifdef SYS_set_mempolicy
+    unsigned long mask[CPU_SETSIZE / (8 * sizeof(unsigned long))] = {0};
+    if (node == -1) {
+        syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+        return;
+    }
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, CPU_SETSIZE);
+#else
+    (void)node;
+#endif
+}
+
+// SIGXCPU when the process used limit seconds of CPU, SIGKILL one second later
+static void limit_cpu(pid_t pid, long limit) {
+    struct rlimit rl = {limit, limit + 1};
+    prlimit(pid, RLIMIT_CPU, &rl, NULL);
+}
+
+// Start path: through the spawn server when there is one, else posix_spawn
+static int spawn(pid_t* pid, const char* path, struct launch* p,
+                 posix_spawn_file_actions_t* actions, posix_spawnattr_t* attr) {
+    // The server would not pass on the memory policy nor the affinity
+    int err = (p->mem_node == -1 && p->cpus == NULL) ? spawn_server_spawn(path, p, pid) : -1;
+    if (err != -1) {
+        return err;
+    }
+    // posix_spawn has no attribute for them: the child inherits them from
+    // the shell, which gets back its own right after
+    if (p->mem_node != -1) {
+        set_mem_node(p->mem_node);
+    }
+    cpu_set_t cpus;
+    int pinned = p->cpus != NULL && sched_getaffinity(0, sizeof(cpus), &cpus) == 0;
+    if (pinned) {
+        sched_setaffinity(0, sizeof(cpu_set_t), p->cpus);
+    }
+    err = posix_spawn(pid, path, actions, attr, p->argv, environ);
+    if (pinned) {
+        sched_setaffinity(0, sizeof(cpus), &cpus);
+    }
+    if (p->mem_node != -1) {
+        set_mem_node(-1);
+    }
+    return err;
+}
+
+// Start path, and run it with /bin/sh if it is a script without #!
+static int spawn_command(pid_t* pid, const char* path, struct launch* p,
+                         posix_spawn_file_actions_t* actions, posix_spawnattr_t* attr) {
+    int err = spawn(pid, path, p, actions, attr);
+    if (err != ENOEXEC) {
+        return err;
+    }
+    int argc = 0;
+    while (p->argv[argc] != NULL) {
+        argc++;
+    }
+    // sh path arguments..., the null pointer included
+    char* sh_argv[argc + 2];
+    sh_argv[0] = "/bin/sh";
+    sh_argv[1] = (char*)path;
+    memcpy(sh_argv + 2, p->argv + 1, argc * sizeof(char*));
+    char** argv = p->argv;
+    p->argv = sh_argv;
+    err = spawn(pid, "/bin/sh", p, actions, attr);
+    p->argv = argv;
+    return err;
+}
+
+// The spawn of p failed with err: tell whether a redirection is to blame,
+// checked in the order the child opened them. Return its error, or err.
+static int launch_failure(struct launch* p, int err) {
+    if (p->in && access(p->in, R_OK) == -1) {
+        p->failed = p->in;
+        return errno;
+    }
+    if (p->out) {
+        // Not created here: the child went on to the exec only if it exists
+        int fd = open(p->out, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1 && errno != ENXIO) {
+            p->failed = p->out;
+            return errno;
+        }
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    return err;
+}
+
+// Exec argv in the child of launch_function(): return only on failure
+static int exec_command(char** argv) {
+    execvp(argv[0], argv);
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+    return 127;
+}
+
+pid_t launch(struct launch* p) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    pid_t pid;
+    int err;
+
+    // Neither posix_spawn nor the spawn server can set a limit: the child
+    // of a fork sets it before the exec, so that it binds every process
+    // the command starts
+    if (p->cpu_limit) {
+        return launch_function(p, exec_command);
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    // Join the process group before exec, like setpgid() after a fork
+    short flags = POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    posix_spawnattr_setflags(&attr, flags);
+    posix_spawnattr_setpgroup(&attr, p->pgid);
+    // The child must not inherit the signals blocked or ignored by the shell
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigfillset(&mask);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 35)
+    // Done by the child itself, before fd 0 is redirected, so that it never
+    // reads the terminal while in a background process group
+    if (p->foreground && isatty(0) && tcgetpgrp(0) == getpgrp()) {
+        posix_spawn_file_actions_addtcsetpgrp_np(&actions, 0);
+    }
+#endif
+#endif
+
+    // Connect the standard input
+    if (p->in) {
+        posix_spawn_file_actions_addopen(&actions, 0, p->in, O_RDONLY, 0);
+    } else if (p->fd_in != -1) {
+        posix_spawn_file_actions_adddup2(&actions, p->fd_in, 0);
+    }
+
+    // Connect the standard output
+    if (p->out) {
+        posix_spawn_file_actions_addopen(&actions, 1, p->out, O_WRONLY | O_TRUNC | O_CREAT, 0644);
+    } else if (p->fd_out != -1) {
+        posix_spawn_file_actions_adddup2(&actions, p->fd_out, 1);
+    }
+    if (p->fd_err != -1) {
+        posix_spawn_file_actions_adddup2(&actions, p->fd_err, 2);
+    }
+
+    // execv on the cached path rather than trying every directory of PATH
+    const char* path = path_lookup(p->argv[0]);
+    if (path == NULL) {
+        err = ENOENT;
+    } else {
+        err = spawn_command(&pid, path, p, &actions, &attr);
+        if (err == ENOENT && access(path, X_OK) == -1 && path != p->argv[0]) {
+            // The cached command was removed, or moved in PATH
+            path_forget(p->argv[0]);
+            path = path_lookup(p->argv[0]);
+            if (path != NULL) {
+                err = spawn_command(&pid, path, p, &actions, &attr);
+            }
+        }
+        if (err != 0) {
+            err = launch_failure(p, err);
+        }
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+// Connect fd to the file path, or to from when path is null
+static void redirect(int fd, char* path, int flags, int from) {
+    if (path != NULL) {
+        int f = open(path, flags, 0644);
+        if (f == -1) {
+            fprintf(stderr, "[ERROR] open %s: ", path);
+            perror(NULL);
+            _exit(1);
+        }
+        dup2(f, fd);
+        close(f);
+    } else if (from != -1) {
+        dup2(from, fd);
+    }
+}
+
+pid_t launch_function(struct launch* p, int (*fn)(char** argv)) {
+    pid_t shell_pgid = getpgrp();
+    // The child must not print again what the shell did not flush yet
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid != 0) {
+        if (pid > 0) {
+            // Also done by the parent, so that the group exists when it returns
+            setpgid(pid, p->pgid ? p->pgid : pid);
+        }
+        return pid;
+    }
+
+    setpgid(0, p->pgid);
+    if (p->foreground && isatty(0) && tcgetpgrp(0) == shell_pgid) {
+        tcsetpgrp(0, getpgrp());
+    }
+    for (int sig = 1; sig < NSIG; sig++) {
+        signal(sig, SIG_DFL);
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+    if (p->cpu_limit) {
+        limit_cpu(0, p->cpu_limit);
+    }
+    if (p->cpus) {
+        sched_setaffinity(0, sizeof(cpu_set_t), p->cpus);
+    }
+    if (p->mem_node != -1) {
+        set_mem_node(p->mem_node);
+    }
+
+    redirect(0, p->in, O_RDONLY, p->fd_in);
+    redirect(1, p->out, O_WRONLY | O_TRUNC | O_CREAT, p->fd_out);
+    redirect(2, NULL, 0, p->fd_err);
+    // Without exec the close-on-exec descriptors of the shell stay open,
+    // and a pipe end kept here would hide the exit of the other side
+#ifdef HAVE_CLOSEFROM
+    closefrom(3);
+#else
+    for (int fd = 3; fd < sysconf(_SC_OPEN_MAX); fd++) {
+        close(fd);
+    }
+#endif
+
+    int status = fn(p->argv);
+    fflush(NULL);
+    _exit(status);
+}
+
+int ulimit_builtin(char** argv) {
+    int i = (argv[1] != NULL && !strcmp(argv[1], "-t")) ? 2 : 1;
+    if (argv[i] == NULL) {
+        if (launch_cpu_limit == 0) {
+            printf("unlimited\n");
+        } else {
+            printf("%ld\n", launch_cpu_limit);
+        }
+        return 0;
+    }
+    char* end;
+    long limit = strtol(argv[i], &end, 10);
+    if (argv[i + 1] == NULL && !strcmp(argv[i], "unlimited")) {
+        launch_cpu_limit = 0;
+    } else if (argv[i + 1] == NULL && end != argv[i] && *end == '\0' && limit > 0) {
+        launch_cpu_limit = limit;
+    } else {
+        fprintf(stderr, "ulimit: usage: ulimit [-t] [SECONDS|unlimited]\n");
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __LAUNCHER_H
+#define __LAUNCHER_H
+
+#include <sched.h>
+#include <sys/types.h>
+
+/* Description of a process to launch */
+struct launch {
+    char** argv;     /* Command and its arguments, null terminated */
+    char* in;        /* If not null: file opened as standard input */
+    char* out;       /* If not null: file truncated and opened as standard output */
+    int fd_in;       /* If not -1 (and in is null): fd connected to standard input */
+    int fd_out;      /* If not -1 (and out is null): fd connected to standard output */
+    int fd_err;      /* If not -1: fd connected to standard error */
+    pid_t pgid;      /* Process group to join, 0 to create a new one */
+    int foreground;  /* If set the new process group gets the terminal */
+    long cpu_limit;  /* If not 0: limit of CPU time in seconds (RLIMIT_CPU) */
+    const cpu_set_t* cpus;  /* If not null: CPUs the process may run on */
+    int mem_node;    /* If not -1: NUMA node preferred for its memory */
+    char* failed;    /* Set by launch(): in or out if it could not be opened */
+};
+
+/* CPU time limit of the commands, 0 for none, set by the ulimit builtin */
+extern long launch_cpu_limit;
+
+/* Initialise p to launch argv with no redirection in a new process group,
+   under launch_cpu_limit */
+void launch_init(struct launch* p, char** argv);
+
+/* Launch the process described by p with posix_spawn, which does not copy
+   the address space of the shell. The command is looked up with
+   path_lookup(), and handed to the spawn server (spawnsrv.h) if it
+   runs. The file descriptors given in p must be
+   close-on-exec (see pipe2), they are only inherited as 0, 1 and 2.
+   A script without #! is run by /bin/sh, like execvp() does. Under a
+   CPU limit the process is forked like launch_function() does, the limit
+   being set before the exec.
+   Return the pid of the new process, or -1 with errno set if the command
+   or one of its redirections could not be used, p->failed telling which. */
+pid_t launch(struct launch* p);
+
+/* Run fn(p->argv) in a forked child set up like launch() does (process
+   group, terminal, signals, redirections) and exit with its return value.
+   Used by the builtins run as a pipeline stage or in background, which
+   need no exec. Return the pid of the child, or -1 with errno set. */
+pid_t launch_function(struct launch* p, int (*fn)(char** argv));
+
+/* ulimit [-t] [SECONDS|unlimited]: print or set launch_cpu_limit */
+int ulimit_builtin(char** argv);
+
+#endif
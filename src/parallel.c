@@ -0,0 +1,266 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "parallel.h"
+#include "events.h"
+#include "jobs.h"
+#include "launcher.h"
+#include "script.h"
+
+// Highest -j: each running task holds a pipe and a job
+#define PARALLEL_MAX 1024
+
+// A running task, in one of the N slots of the runner
+struct task {
+    struct job* job;    // NULL: free slot
+    char** argv;        // Owned by the task
+    int fd;             // Read end of its captured output, -1 once at its end
+    char* out;
+    size_t len;
+    size_t cap;
+};
+
+// Copy of arg where each {} is replaced by item
+static char* substitute(const char* arg, const char* item) {
+    size_t item_len = strlen(item);
+    size_t len = strlen(arg);
+    for (const char* p = arg; (p = strstr(p, "{}")) != NULL; p += 2) {
+        len += item_len - 2;
+    }
+    char* copy = malloc(len + 1);
+    char* cur = copy;
+    const char* p;
+    while ((p = strstr(arg, "{}")) != NULL) {
+        memcpy(cur, arg, p - arg);
+        cur += p - arg;
+        memcpy(cur, item, item_len);
+        cur += item_len;
+        arg = p + 2;
+    }
+    strcpy(cur, arg);
+    return copy;
+}
+
+// Command line of the task for item, built from the template
+static char** task_argv(char** template, const char* item) {
+    int n = 0;
+    int placeholder = 0;
+    for (; template[n] != NULL; n++) {
+        placeholder |= (strstr(template[n], "{}") != NULL);
+    }
+    char** argv = malloc((n + 2) * sizeof(char*));
+    for (int i = 0; i < n; i++) {
+        argv[i] = substitute(template[i], item);
+    }
+    if (!placeholder) {
+        argv[n++] = strdup(item);
+    }
+    argv[n] = NULL;
+    return argv;
+}
+
+static char* argv_text(char** argv) {
+    size_t len = 1;
+    for (int i = 0; argv[i] != NULL; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+    char* text = malloc(len);
+    char* cur = text;
+    for (int i = 0; argv[i] != NULL; i++) {
+        cur += sprintf(cur, "%s%s", i ? " " : "", argv[i]);
+    }
+    *cur = '\0';
+    return text;
+}
+
+static void free_argv(char** argv) {
+    for (int i = 0; argv[i] != NULL; i++) {
+        free(argv[i]);
+    }
+    free(argv);
+}
+
+// Append what the task printed to its buffer, until the end of the pipe
+static void task_output(int fd, void* data) {
+    struct task* t = data;
+    if (t->cap - t->len < 4096) {
+        t->cap = t->cap ? 2 * t->cap : 16384;
+        t->out = realloc(t->out, t->cap);
+    }
+    ssize_t n = read(fd, t->out + t->len, t->cap - t->len);
+    if (n > 0) {
+        t->len += n;
+        return;
+    }
+    if (n == -1 && errno == EINTR) {
+        return;
+    }
+    events_unwatch(fd);
+    close(fd);
+    t->fd = -1;
+}
+
+// Launch the task for item in the free slot t. Return 0 if it could not be.
+static int task_start(struct task* t, char** template, const char* item) {
+    int tuyau[2];
+    if (pipe2(tuyau, O_CLOEXEC) == -1) {
+        perror("parallel: pipe");
+        return 0;
+    }
+    t->argv = task_argv(template, item);
+
+    struct launch p;
+    launch_init(&p, t->argv);
+    // The tasks must not read the items, nor the terminal
+    p.in = "/dev/null";
+    p.fd_out = tuyau[1];
+    pid_t pid = launch(&p);
+    close(tuyau[1]);
+    if (pid == -1) {
+        fprintf(stderr, "parallel: %s: %s\n", t->argv[0], strerror(errno));
+        close(tuyau[0]);
+        free_argv(t->argv);
+        return 0;
+    }
+
+    // Hidden from jobs and from the end of job notifications like a
+    // foreground job, it is reaped by the event loop like any other one
+    char* text = argv_text(t->argv);
+    t->job = job_create(text, 1, 1);
+    free(text);
+    job_add_process(t->job, pid);
+    t->fd = tuyau[0];
+    t->len = 0;
+    events_watch(t->fd, task_output, t);
+    return 1;
+}
+
+// Print the output of the ended task and free its slot. Return its status.
+static int task_finish(struct task* t, double* busy) {
+    int status = t->job->status[0];
+    struct job_usage u;
+    job_usage(t->job, -1, &u);
+    *busy += u.real;
+
+    fwrite(t->out, 1, t->len, stdout);
+    fflush(stdout);
+    job_remove(t->job);
+    free_argv(t->argv);
+    t->job = NULL;
+    return status;
+}
+
+int parallel_builtin(char** argv) {
+    long max = sysconf(_SC_NPROCESSORS_ONLN);
+    char* file = "-";
+    int i = 1;
+    for (; argv[i] != NULL && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "--")) {
+            i++;
+            break;
+        } else if (!strcmp(argv[i], "-j") && argv[i + 1] != NULL) {
+            char* end;
+            i++;
+            max = strtol(argv[i], &end, 10);
+            if (end == argv[i] || *end != '\0' || max <= 0 || max > PARALLEL_MAX) {
+                fprintf(stderr, "parallel: %s: invalid number of tasks (1 to %d)\n", argv[i],
+                        PARALLEL_MAX);
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "-a") && argv[i + 1] != NULL) {
+            file = argv[++i];
+        } else {
+            break;
+        }
+    }
+    if (max > PARALLEL_MAX) {
+        max = PARALLEL_MAX;
+    }
+    if (argv[i] == NULL || argv[i][0] == '-' || max <= 0) {
+        fprintf(stderr, "parallel: usage: parallel [-j N] [-a file] command [arg...]\n");
+        return 2;
+    }
+    char** template = argv + i;
+
+    struct script* items = script_open(file);
+    if (items == NULL) {
+        fprintf(stderr, "parallel: %s: %s\n", file, strerror(errno));
+        return 1;
+    }
+
+    struct task* tasks = calloc(max, sizeof(struct task));
+    if (tasks == NULL) {
+        fprintf(stderr, "parallel: %s\n", strerror(errno));
+        script_close(items);
+        return 1;
+    }
+    int nb_running = 0, nb_tasks = 0, nb_failed = 0;
+    int more = 1;
+    double busy = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fflush(stdout);
+
+    while (more || nb_running > 0) {
+        // Fill the free slots, then wait for a task to end
+        for (int k = 0; k < max && more; k++) {
+            if (tasks[k].job != NULL) {
+                continue;
+            }
+            char* item = script_read_line(items);
+            while (item != NULL && item[0] == '\0') {
+                free(item);
+                item = script_read_line(items);
+            }
+            if (item == NULL) {
+                more = 0;
+                break;
+            }
+            nb_tasks++;
+            if (task_start(&tasks[k], template, item)) {
+                nb_running++;
+            } else {
+                nb_failed++;
+            }
+            free(item);
+        }
+        if (nb_running == 0) {
+            continue;
+        }
+        events_poll(-1, -1);
+        for (int k = 0; k < max; k++) {
+            struct task* t = &tasks[k];
+            if (t->job != NULL && t->job->state == JOB_DONE && t->fd == -1) {
+                int status = task_finish(t, &busy);
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    nb_failed++;
+                }
+                nb_running--;
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double makespan = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "parallel: %d tasks, %d failed, makespan %.3fs, %.1f tasks/s, "
+            "%.2f of %ld slots busy\n", nb_tasks, nb_failed, makespan,
+            makespan > 0 ? nb_tasks / makespan : 0, makespan > 0 ? busy / makespan : 0, max);
+
+    for (long k = 0; k < max; k++) {
+        free(tasks[k].out);
+    }
+    free(tasks);
+    script_close(items);
+    return nb_failed ? 1 : 0;
+}
@@ -0,0 +1,19 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __PARALLEL_H
+#define __PARALLEL_H
+
+/* parallel [-j N] [-a file] command [arg...]
+   Run the command once per line read from the standard input (or file),
+   at most N at a time (default: the number of online CPUs). Each {} in
+   the arguments is replaced by the line, which is appended as the last
+   argument if there is no {}. The standard output of each task is
+   captured and printed in one block when it ends. A summary (tasks,
+   makespan, throughput) is printed on the standard error.
+   Return 0 if every task succeeded, 1 otherwise. */
+int parallel_builtin(char** argv);
+
+#endif
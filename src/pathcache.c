@@ -0,0 +1,184 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "pathcache.h"
+
+struct path_entry {
+    char* name;
+    char* path;
+    unsigned hits;
+    struct path_entry* next;
+};
+
+// Chained hash table, the number of buckets is a power of two
+static struct path_entry** buckets = NULL;
+static size_t nb_buckets = 0;
+static size_t nb_entries = 0;
+// Value of PATH the cached paths were resolved with
+static char* cached_path_var = NULL;
+
+// FNV-1a
+static size_t hash_name(const char* name) {
+    size_t h = 2166136261u;
+    for (; *name; name++) {
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    }
+    return h;
+}
+
+static struct path_entry** find_slot(const char* name) {
+    struct path_entry** slot = &buckets[hash_name(name) & (nb_buckets - 1)];
+    while (*slot != NULL && strcmp((*slot)->name, name)) {
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+static void grow(void) {
+    size_t old_nb = nb_buckets;
+    struct path_entry** old = buckets;
+
+    nb_buckets = old_nb ? old_nb * 2 : 64;
+    buckets = calloc(nb_buckets, sizeof(struct path_entry*));
+    for (size_t i = 0; i < old_nb; i++) {
+        struct path_entry* e = old[i];
+        while (e != NULL) {
+            struct path_entry* next = e->next;
+            size_t b = hash_name(e->name) & (nb_buckets - 1);
+            e->next = buckets[b];
+            buckets[b] = e;
+            e = next;
+        }
+    }
+    free(old);
+}
+
+// Search name in the directories of path_var, return a malloc'ed path
+static char* resolve(const char* name, const char* path_var) {
+    size_t name_len = strlen(name);
+    const char* dir = path_var;
+    while (1) {
+        const char* end = strchrnul(dir, ':');
+        size_t dir_len = end - dir;
+        char* candidate = malloc(dir_len + name_len + 3);
+        struct stat st;
+
+        // An empty directory stands for the current directory
+        if (dir_len == 0) {
+            candidate[0] = '.';
+            dir_len = 1;
+        } else {
+            memcpy(candidate, dir, dir_len);
+        }
+        candidate[dir_len] = '/';
+        memcpy(candidate + dir_len + 1, name, name_len + 1);
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0) {
+            return candidate;
+        }
+        free(candidate);
+
+        if (*end == '\0') {
+            return NULL;
+        }
+        dir = end + 1;
+    }
+}
+
+const char* path_lookup(const char* name) {
+    if (strchr(name, '/') != NULL) {
+        return name;
+    }
+
+    const char* path_var = getenv("PATH");
+    if (path_var == NULL) {
+        path_var = "/bin:/usr/bin";
+    }
+    if (cached_path_var == NULL || strcmp(cached_path_var, path_var)) {
+        path_clear();
+        free(cached_path_var);
+        cached_path_var = strdup(path_var);
+    }
+
+    if (nb_buckets == 0) {
+        grow();
+    }
+    struct path_entry** slot = find_slot(name);
+    if (*slot == NULL) {
+        char* path = resolve(name, path_var);
+        if (path == NULL) {
+            return NULL;
+        }
+        struct path_entry* e = malloc(sizeof(struct path_entry));
+        e->name = strdup(name);
+        e->path = path;
+        e->hits = 0;
+        e->next = NULL;
+        *slot = e;
+        if (++nb_entries > nb_buckets) {
+            grow();
+            slot = find_slot(name);
+        }
+    }
+    (*slot)->hits++;
+    return (*slot)->path;
+}
+
+void path_forget(const char* name) {
+    if (nb_buckets == 0) {
+        return;
+    }
+    struct path_entry** slot = find_slot(name);
+    struct path_entry* e = *slot;
+    if (e != NULL) {
+        *slot = e->next;
+        free(e->name);
+        free(e->path);
+        free(e);
+        nb_entries--;
+    }
+}
+
+void path_clear(void) {
+    for (size_t i = 0; i < nb_buckets; i++) {
+        struct path_entry* e = buckets[i];
+        while (e != NULL) {
+            struct path_entry* next = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            e = next;
+        }
+        buckets[i] = NULL;
+    }
+    nb_entries = 0;
+}
+
+void path_destroy(void) {
+    path_clear();
+    free(buckets);
+    buckets = NULL;
+    nb_buckets = 0;
+    free(cached_path_var);
+    cached_path_var = NULL;
+}
+
+void path_print(FILE* out) {
+    if (nb_entries == 0) {
+        fprintf(out, "hash: hash table empty\n");
+        return;
+    }
+    fprintf(out, "hits\tcommand\n");
+    for (size_t i = 0; i < nb_buckets; i++) {
+        for (struct path_entry* e = buckets[i]; e != NULL; e = e->next) {
+            fprintf(out, "%4u\t%s\n", e->hits, e->path);
+        }
+    }
+}
@@ -0,0 +1,29 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __PATHCACHE_H
+#define __PATHCACHE_H
+
+#include <stdio.h>
+
+/* Return the absolute path of the command name, looked up in the
+   directories of PATH on first use and cached afterwards. A name
+   containing a '/' is returned as is. Return NULL if name is not found.
+   The whole cache is dropped when PATH changes. */
+const char* path_lookup(const char* name);
+
+/* Drop the cached path of name, e.g. when it does not exist anymore */
+void path_forget(const char* name);
+
+/* Drop all cached paths */
+void path_clear(void);
+
+/* Drop all cached paths and free the table, at exit */
+void path_destroy(void);
+
+/* Print the cached commands and how many times each one was used */
+void path_print(FILE* out);
+
+#endif
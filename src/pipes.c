@@ -0,0 +1,95 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pipes.h"
+
+struct pipe_conf pipe_default = {0, 0};
+
+int pipe_conf_parse(const char* spec, struct pipe_conf* c) {
+    struct pipe_conf conf = {0, 0};
+    const char* comma = strchr(spec, ',');
+    size_t len = comma ? (size_t)(comma - spec) : strlen(spec);
+
+    if (comma != NULL && strcmp(comma + 1, "direct") != 0) {
+        return -1;
+    }
+    conf.direct = (comma != NULL);
+    if (len == 3 && !strncmp(spec, "max", 3)) {
+        conf.size = -1;
+    } else if (len != 7 || strncmp(spec, "default", 7) != 0) {
+        char* end;
+        conf.size = strtol(spec, &end, 10);
+        if (end == spec || conf.size <= 0) {
+            return -1;
+        }
+        if (*end == 'k' || *end == 'K') {
+            conf.size <<= 10;
+            end++;
+        } else if (*end == 'm' || *end == 'M') {
+            conf.size <<= 20;
+            end++;
+        }
+        if (end != spec + len) {
+            return -1;
+        }
+    }
+    *c = conf;
+    return 0;
+}
+
+long pipe_max_size(void) {
+    static long max = 0;
+    if (max == 0) {
+        FILE* f = fopen("/proc/sys/fs/pipe-max-size", "r");
+        if (f == NULL || fscanf(f, "%ld", &max) != 1) {
+            max = 1024 * 1024;
+        }
+        if (f != NULL) {
+            fclose(f);
+        }
+    }
+    return max;
+}
+
+int pipe_open(int fds[2], const struct pipe_conf* c) {
+    if (pipe2(fds, O_CLOEXEC | (c->direct ? O_DIRECT : 0)) == -1) {
+        return -1;
+    }
+    if (c->size != 0) {
+        long size = c->size;
+        if (size == -1 || size > pipe_max_size()) {
+            size = pipe_max_size();
+        }
+        // May fail past the pipe-user-pages-soft limit: keep the default
+        fcntl(fds[1], F_SETPIPE_SZ, (int)size);
+    }
+    return 0;
+}
+
+int pipesize_builtin(char** argv) {
+    if (argv[1] == NULL) {
+        if (pipe_default.size == 0) {
+            printf("pipesize default");
+        } else if (pipe_default.size == -1) {
+            printf("pipesize max");
+        } else {
+            printf("pipesize %ld", pipe_default.size);
+        }
+        printf("%s (max %ld)\n", pipe_default.direct ? ",direct" : "", pipe_max_size());
+        return 0;
+    }
+    if (argv[2] != NULL || pipe_conf_parse(argv[1], &pipe_default) == -1) {
+        fprintf(stderr, "pipesize: usage: pipesize [SIZE[k|m]|max|default][,direct]\n");
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __PIPES_H
+#define __PIPES_H
+
+/* Options of the pipes created between the commands of a pipeline */
+struct pipe_conf {
+    long size;      /* Capacity set with F_SETPIPE_SZ, 0 for the default
+                       of the system, -1 for /proc/sys/fs/pipe-max-size */
+    int direct;     /* If set the pipes are in packet mode (O_DIRECT): each
+                       write is read as a whole, or its end is lost */
+};
+
+/* Options of the pipes of the command lines without pipesize= prefix,
+   set by the pipesize builtin */
+extern struct pipe_conf pipe_default;
+
+/* Parse spec: SIZE (bytes, or with a k or m suffix), max or default,
+   optionally followed by ",direct". Return 0, or -1 if spec is invalid. */
+int pipe_conf_parse(const char* spec, struct pipe_conf* c);
+
+/* pipe2(fds, O_CLOEXEC) with the options of c. A size over the maximum
+   allowed is lowered to it, and a size which cannot be set is ignored.
+   Return -1 with errno set if the pipe cannot be created. */
+int pipe_open(int fds[2], const struct pipe_conf* c);
+
+/* Content of /proc/sys/fs/pipe-max-size, read once */
+long pipe_max_size(void);
+
+/* pipesize [SPEC]: print or set pipe_default */
+int pipesize_builtin(char** argv);
+
+#endif
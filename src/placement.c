@@ -0,0 +1,262 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "placement.h"
+
+enum placement_mode {
+    PLACE_NONE,
+    PLACE_COMPACT,
+    PLACE_SPREAD,
+    PLACE_NODES,
+    PLACE_CPULIST,
+};
+
+static const char* mode_names[] = {"none", "compact", "spread", "nodes"};
+
+struct cpu {
+    int cpu;
+    int package;
+    int core;
+    int thread;     // Rank among the SMT siblings of its core
+    int core_rank;  // Rank of its core in its package
+};
+
+static enum placement_mode mode = PLACE_NONE;
+static int next = 0;                // Round-robin position
+
+// Topology of the CPUs the shell may use, read once
+static int nb_cpus = 0;
+static cpu_set_t* compact = NULL;   // One set per CPU, siblings and cores adjacent
+static cpu_set_t* spread = NULL;    // One set per CPU, packages then cores first
+static int nb_nodes = 0;
+static cpu_set_t* node_cpus = NULL;
+static int* node_ids = NULL;        // -1 without NUMA information
+static cpu_set_t wide;              // CPUs of the last replicated stage
+static cpu_set_t list;              // CPUs of the CPULIST policy
+static char list_text[256];
+
+// Parse a list like 0-3,8 (the format of sysfs) into set. Return -1 if
+// it is invalid or empty.
+static int parse_cpulist(const char* s, cpu_set_t* set) {
+    CPU_ZERO(set);
+    while (*s != '\0' && *s != '\n') {
+        char* end;
+        long first = strtol(s, &end, 10);
+        long last = first;
+        if (end == s) {
+            return -1;
+        }
+        if (*end == '-') {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+            if (end == s) {
+                return -1;
+            }
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long c = first; c <= last; c++) {
+            CPU_SET(c, set);
+        }
+        s = end;
+        if (*s == ',') {
+            s++;
+        } else if (*s != '\0' && *s != '\n') {
+            return -1;
+        }
+    }
+    return CPU_COUNT(set) ? 0 : -1;
+}
+
+// First line of a sysfs file, into buf. Return 0, or -1 if unreadable.
+static int read_sysfs(const char* path, char* buf, int size) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    int ok = fgets(buf, size, f) != NULL;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+static int read_topology(int cpu, const char* name, int fallback) {
+    char path[128], buf[32];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    return read_sysfs(path, buf, sizeof(buf)) == 0 ? atoi(buf) : fallback;
+}
+
+static int compact_cmp(const void* a, const void* b) {
+    const struct cpu* x = a;
+    const struct cpu* y = b;
+    if (x->package != y->package) {
+        return x->package - y->package;
+    }
+    if (x->core != y->core) {
+        return x->core - y->core;
+    }
+    return x->cpu - y->cpu;
+}
+
+static int spread_cmp(const void* a, const void* b) {
+    const struct cpu* x = a;
+    const struct cpu* y = b;
+    if (x->thread != y->thread) {
+        return x->thread - y->thread;
+    }
+    if (x->core_rank != y->core_rank) {
+        return x->core_rank - y->core_rank;
+    }
+    if (x->package != y->package) {
+        return x->package - y->package;
+    }
+    return x->cpu - y->cpu;
+}
+
+static void load_topology(void) {
+    if (nb_cpus != 0) {
+        return;
+    }
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        CPU_ZERO(&allowed);
+        CPU_SET(0, &allowed);
+    }
+
+    struct cpu* cpus = malloc(CPU_COUNT(&allowed) * sizeof(struct cpu));
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &allowed)) {
+            cpus[nb_cpus].cpu = c;
+            cpus[nb_cpus].package = read_topology(c, "physical_package_id", 0);
+            cpus[nb_cpus].core = read_topology(c, "core_id", c);
+            nb_cpus++;
+        }
+    }
+    qsort(cpus, nb_cpus, sizeof(struct cpu), compact_cmp);
+    compact = malloc(nb_cpus * sizeof(cpu_set_t));
+    for (int i = 0; i < nb_cpus; i++) {
+        CPU_ZERO(&compact[i]);
+        CPU_SET(cpus[i].cpu, &compact[i]);
+        // Siblings and cores are consecutive in the compact order
+        int same_core = i > 0 && cpus[i].package == cpus[i - 1].package
+                        && cpus[i].core == cpus[i - 1].core;
+        int same_package = i > 0 && cpus[i].package == cpus[i - 1].package;
+        cpus[i].thread = same_core ? cpus[i - 1].thread + 1 : 0;
+        cpus[i].core_rank = !same_package ? 0 : cpus[i - 1].core_rank + !same_core;
+    }
+    qsort(cpus, nb_cpus, sizeof(struct cpu), spread_cmp);
+    spread = malloc(nb_cpus * sizeof(cpu_set_t));
+    for (int i = 0; i < nb_cpus; i++) {
+        CPU_ZERO(&spread[i]);
+        CPU_SET(cpus[i].cpu, &spread[i]);
+    }
+    free(cpus);
+
+    // The NUMA nodes which have some of the allowed CPUs
+    char buf[4096];
+    cpu_set_t online;
+    if (read_sysfs("/sys/devices/system/node/online", buf, sizeof(buf)) == 0
+        && parse_cpulist(buf, &online) == 0) {
+        node_cpus = malloc(CPU_COUNT(&online) * sizeof(cpu_set_t));
+        node_ids = malloc(CPU_COUNT(&online) * sizeof(int));
+        for (int n = 0; n < CPU_SETSIZE; n++) {
+            char path[128];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+            if (!CPU_ISSET(n, &online) || read_sysfs(path, buf, sizeof(buf)) == -1
+                || parse_cpulist(buf, &node_cpus[nb_nodes]) == -1) {
+                continue;
+            }
+            CPU_AND(&node_cpus[nb_nodes], &node_cpus[nb_nodes], &allowed);
+            if (CPU_COUNT(&node_cpus[nb_nodes]) > 0) {
+                node_ids[nb_nodes++] = n;
+            }
+        }
+    }
+    if (nb_nodes == 0) {
+        node_cpus = realloc(node_cpus, sizeof(cpu_set_t));
+        node_ids = realloc(node_ids, sizeof(int));
+        node_cpus[0] = allowed;
+        node_ids[0] = -1;
+        nb_nodes = 1;
+    }
+}
+
+int placement_start(int nb_procs) {
+    int base = next;
+    if (mode == PLACE_COMPACT || mode == PLACE_SPREAD) {
+        next = (next + nb_procs) % nb_cpus;
+    } else if (mode == PLACE_NODES) {
+        next = (next + 1) % nb_nodes;
+    }
+    return base;
+}
+
+// The nb CPUs of table from first on, round-robin
+static const cpu_set_t* cpus_from(const cpu_set_t* table, int first, int nb) {
+    if (nb == 1) {
+        return &table[first % nb_cpus];
+    }
+    CPU_ZERO(&wide);
+    for (int i = 0; i < nb && i < nb_cpus; i++) {
+        CPU_OR(&wide, &wide, &table[(first + i) % nb_cpus]);
+    }
+    return &wide;
+}
+
+void placement_set(struct launch* p, int base, int slot, int nb) {
+    switch (mode) {
+    case PLACE_COMPACT:
+        p->cpus = cpus_from(compact, base + slot, nb);
+        break;
+    case PLACE_SPREAD:
+        p->cpus = cpus_from(spread, base + slot, nb);
+        break;
+    case PLACE_NODES:
+        p->cpus = &node_cpus[base];
+        p->mem_node = node_ids[base];
+        break;
+    case PLACE_CPULIST:
+        p->cpus = &list;
+        break;
+    default:
+        break;
+    }
+}
+
+int affinity_builtin(char** argv) {
+    if (argv[1] == NULL) {
+        load_topology();
+        printf("affinity %s (%d cpus, %d nodes)\n",
+               mode == PLACE_CPULIST ? list_text : mode_names[mode], nb_cpus, nb_nodes);
+        return 0;
+    }
+    if (argv[2] != NULL) {
+        fprintf(stderr, "affinity: usage: affinity [none|compact|spread|nodes|CPULIST]\n");
+        return 2;
+    }
+    for (int m = PLACE_NONE; m < PLACE_CPULIST; m++) {
+        if (!strcmp(argv[1], mode_names[m])) {
+            load_topology();
+            mode = m;
+            next = 0;
+            return 0;
+        }
+    }
+    cpu_set_t set;
+    if (parse_cpulist(argv[1], &set) == -1 || strlen(argv[1]) >= sizeof(list_text)) {
+        fprintf(stderr, "affinity: %s: invalid CPU list\n", argv[1]);
+        return 1;
+    }
+    list = set;
+    strcpy(list_text, argv[1]);
+    mode = PLACE_CPULIST;
+    return 0;
+}
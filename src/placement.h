@@ -0,0 +1,36 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __PLACEMENT_H
+#define __PLACEMENT_H
+
+#include "launcher.h"
+
+/*
+ * Placement of the launched processes on the CPUs the shell may use,
+ * set by the affinity builtin:
+ *   none      the processes inherit the affinity of the shell
+ *   compact   the stages of a pipeline go to adjacent CPUs, which share
+ *             caches (SMT siblings, then cores of the same package)
+ *   spread    each process goes to the next CPU, round-robin
+ *   nodes     each job goes to the next NUMA node: its CPUs, and its
+ *             memory preferably
+ *   CPULIST   every process is restricted to the list (0-3,8)
+ */
+
+/* Start the placement of a job of nb_procs processes: return the value to
+   give to placement_set() for each of them */
+int placement_start(int nb_procs);
+
+/* Set the CPUs and memory node of the process at position slot of a job,
+   which is given nb CPUs from there: one per replica of a |N stage,
+   counted as nb processes by placement_start(). The set of several CPUs
+   is only valid until the next call. */
+void placement_set(struct launch* p, int base, int slot, int nb);
+
+/* affinity [none|compact|spread|nodes|CPULIST]: print or set the policy */
+int affinity_builtin(char** argv);
+
+#endif
@@ -30,131 +30,392 @@ static void *xmalloc(size_t size)
 }
 
 
-static void *xrealloc(void *ptr, size_t size)
+/*
+ * All the memory of a parsed command line (words, commands and sequence
+ * arrays) comes from a bump arena, reset by the next call of parsecmd().
+ * A block is chained to the previous ones when the current one is full.
+ */
+struct arena_block {
+	struct arena_block *prev;
+	size_t size;	/* Usable bytes in data */
+	size_t used;
+	char data[];
+};
+
+#define ARENA_ALIGN (sizeof(void *))
+#define ARENA_MIN_BLOCK 4096
+#define ARENA_MAX_KEPT (4 * ARENA_MIN_BLOCK)
+
+static struct arena_block *arena = 0;
+static char *arena_last = 0;	/* Last allocation, which can grow in place */
+
+static size_t arena_align(size_t size)
 {
-	void *p = realloc(ptr, size);
-	if (!p) memory_error();
-	return p;
+	return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static void *arena_alloc(size_t size)
+{
+	size = arena_align(size);
+	if (!arena || arena->size - arena->used < size) {
+		size_t block = arena ? 2 * arena->size : ARENA_MIN_BLOCK;
+		struct arena_block *b;
+
+		if (block < size) block = size;
+		b = xmalloc(sizeof(struct arena_block) + block);
+		b->prev = arena;
+		b->size = block;
+		b->used = 0;
+		arena = b;
+	}
+	arena_last = arena->data + arena->used;
+	arena->used += size;
+	return arena_last;
+}
+
+/* Resize p from old_size to new_size bytes, in place if it is the last
+   allocation of the arena */
+static void *arena_grow(void *p, size_t old_size, size_t new_size)
+{
+	char *q;
+
+	if (p && p == arena_last
+	    && (size_t)(arena_last - arena->data) + arena_align(new_size) <= arena->size) {
+		arena->used = (arena_last - arena->data) + arena_align(new_size);
+		return p;
+	}
+	q = arena_alloc(new_size);
+	if (p) memcpy(q, p, old_size);
+	return q;
+}
+
+static void arena_free(void)
+{
+	while (arena) {
+		struct arena_block *prev = arena->prev;
+		free(arena);
+		arena = prev;
+	}
+	arena_last = 0;
+}
+
+/* Forget all the allocations. The blocks are merged in a single one,
+   big enough for a command line like the previous one, unless it is
+   much bigger than the default block: one pasted line of megabytes
+   would stay allocated for the rest of the session otherwise */
+static void arena_reset(void)
+{
+	struct arena_block *b;
+	size_t total = 0;
+
+	for (b = arena; b; b = b->prev)
+		total += b->size;
+	if (arena && (arena->prev || total > ARENA_MAX_KEPT)) {
+		arena_free();
+		if (total > ARENA_MAX_KEPT)
+			total = ARENA_MIN_BLOCK;
+		arena = xmalloc(sizeof(struct arena_block) + total);
+		arena->prev = 0;
+		arena->size = total;
+	}
+	if (arena) arena->used = 0;
+	arena_last = 0;
+}
+
+/* Append item to the null terminated array tab of *len items, which has
+   room for *cap items. Return the array, which may have moved. */
+static void **arena_push(void **tab, size_t *len, size_t *cap, void *item)
+{
+	if (*len + 2 > *cap) {
+		size_t new_cap = *cap ? 2 * *cap : 8;
+		tab = arena_grow(tab, *cap * sizeof(void *), new_cap * sizeof(void *));
+		*cap = new_cap;
+	}
+	tab[(*len)++] = item;
+	tab[*len] = 0;
+	return tab;
 }
 
 #if USE_GNU_READLINE == 0
-/* Read a line from standard input and put it in a char[] */
+/* Read a line from standard input and put it in a char[].
+   getline() grows the buffer and returns the length, so that the line
+   is not scanned again by strlen() after each growth. */
 char *readline(char *prompt)
 {
-	size_t buf_len = 16;
-	char *buf = xmalloc(buf_len * sizeof(char));
+	char *buf = 0;
+	size_t buf_len = 0;
+	ssize_t l;
 
-	printf(prompt);
-	if (fgets(buf, buf_len, stdin) == NULL) {
+	fputs(prompt, stdout);
+	fflush(stdout);
+	errno = 0;
+	l = getline(&buf, &buf_len, stdin);
+	if (l == -1) {
 		free(buf);
+		if (errno == ENOMEM) memory_error();
 		return NULL;
 	}
+	if ((l > 0) && (buf[l-1] == '\n')) buf[l-1] = 0;
+	return buf;
+}
+#endif
 
-	do {
-		size_t l = strlen(buf);
-		if ((l > 0) && (buf[l-1] == '\n')) {
-			l--;
-			buf[l] = 0;
-			return buf;
-		}
-		if (buf_len >= (INT_MAX / 2)) memory_error();
-		buf_len *= 2;
-		buf = xrealloc(buf, buf_len * sizeof(char));
-		if (fgets(buf + l, buf_len - l, stdin) == NULL) return buf;
-	} while (1);
+/*
+ * Tokenizer. Each byte has a class, and the runs of ordinary characters
+ * are found with vector compares (AVX2 when the CPU has it, SSE2, or a
+ * scalar loop on the class table) and copied with memcpy.
+ * The end of the line is always given, so that no vector load goes past
+ * the terminating null byte.
+ */
+enum char_class {
+	CC_ORDINARY = 0,
+	CC_END,		/* '\0' */
+	CC_BLANK,	/* ' ' '\t' */
+	CC_OPERATOR,	/* '<' '>' '|' '&' */
+	CC_SQUOTE,
+	CC_DQUOTE,
+	CC_BACKSLASH,
+};
+
+static const unsigned char char_class[256] = {
+	['\0'] = CC_END,
+	[' '] = CC_BLANK,
+	['\t'] = CC_BLANK,
+	['<'] = CC_OPERATOR,
+	['>'] = CC_OPERATOR,
+	['|'] = CC_OPERATOR,
+	['&'] = CC_OPERATOR,
+	['\''] = CC_SQUOTE,
+	['"'] = CC_DQUOTE,
+	['\\'] = CC_BACKSLASH,
+};
+
+#define CLASS(c) char_class[(unsigned char)(c)]
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/* First special character from p, stops when less than 32 bytes remain */
+__attribute__((target("avx2")))
+static const char *skip_ordinary_avx2(const char *p, const char *end)
+{
+	const __m256i blank = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+	const __m256i lt = _mm256_set1_epi8('<'), gt = _mm256_set1_epi8('>');
+	const __m256i bar = _mm256_set1_epi8('|'), amp = _mm256_set1_epi8('&');
+	const __m256i sq = _mm256_set1_epi8('\''), dq = _mm256_set1_epi8('"');
+	const __m256i bs = _mm256_set1_epi8('\\');
+
+	for (; end - p >= 32; p += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		__m256i m = _mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, blank), _mm256_cmpeq_epi8(v, tab)),
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, lt), _mm256_cmpeq_epi8(v, gt))),
+			_mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, bar), _mm256_cmpeq_epi8(v, amp)),
+				_mm256_or_si256(
+					_mm256_or_si256(_mm256_cmpeq_epi8(v, sq), _mm256_cmpeq_epi8(v, dq)),
+					_mm256_cmpeq_epi8(v, bs))));
+		unsigned mask = _mm256_movemask_epi8(m);
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+	return p;
 }
 #endif
 
-#define READ_CHAR *(*cur_buf)++ = *(*cur)++
-#define SKIP_CHAR (*cur)++
-
-static void read_single_quote(char ** cur, char ** cur_buf) {
-	SKIP_CHAR;
-	while(1) {
-		char c = **cur;
-		switch(c) {
-                case '\'':
-                        SKIP_CHAR;
-                        return;
-                case '\0':
-                        fprintf(stderr, "Missing closing '\n");
-                        return;
-                default:
-                        READ_CHAR;
-                        break;
-                }
+#ifdef __SSE2__
+/* Bit i is set if p[i] is special, for the 16 bytes at p */
+static inline unsigned special_mask_sse2(const char *p)
+{
+	const __m128i blank = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+	const __m128i lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>');
+	const __m128i bar = _mm_set1_epi8('|'), amp = _mm_set1_epi8('&');
+	const __m128i sq = _mm_set1_epi8('\''), dq = _mm_set1_epi8('"');
+	const __m128i bs = _mm_set1_epi8('\\');
+	__m128i v = _mm_loadu_si128((const __m128i *)p);
+	__m128i m = _mm_or_si128(
+		_mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, blank), _mm_cmpeq_epi8(v, tab)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt))),
+		_mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, bar), _mm_cmpeq_epi8(v, amp)),
+			_mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, sq), _mm_cmpeq_epi8(v, dq)),
+				_mm_cmpeq_epi8(v, bs))));
+
+	return _mm_movemask_epi8(m);
+}
+
+/* First '"' or '\\' from p, or end */
+static inline const char *skip_dquoted(const char *p, const char *end)
+{
+	const __m128i dq = _mm_set1_epi8('"'), bs = _mm_set1_epi8('\\');
+
+	for (; end - p >= 16; p += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, dq),
+							       _mm_cmpeq_epi8(v, bs)));
+		if (mask)
+			return p + __builtin_ctz(mask);
 	}
+	while (p < end && *p != '"' && *p != '\\')
+		p++;
+	return p;
+}
+#else
+static const char *skip_dquoted(const char *p, const char *end)
+{
+	while (p < end && *p != '"' && *p != '\\')
+		p++;
+	return p;
 }
+#endif
+
+/* First character of p which is not ordinary, end at the latest */
+static inline const char *skip_ordinary(const char *p, const char *end)
+{
+#ifdef __SSE2__
+	/* Most words are short: the first 16 bytes are checked inline, the
+	   long runs go on with the widest vectors available */
+	while (end - p >= 16) {
+		unsigned mask = special_mask_sse2(p);
+		if (mask)
+			return p + __builtin_ctz(mask);
+		p += 16;
+#if defined(__x86_64__) || defined(__i386__)
+		{
+			static int has_avx2 = -1;
+
+			if (has_avx2 < 0)
+				has_avx2 = __builtin_cpu_supports("avx2");
+			if (has_avx2)
+				p = skip_ordinary_avx2(p, end);
+		}
+#endif
+	}
+#endif
+	while (p < end && CLASS(*p) == CC_ORDINARY)
+		p++;
+	return p;
+}
+
+/* Copy the characters from *cur to q in *cur_buf. A short run is copied
+   as a whole 16 bytes block: the word buffer has room for it, and the
+   extra bytes are overwritten by what comes next. */
+static inline void copy_run(char **cur, char **cur_buf, const char *q, const char *end)
+{
+	size_t n = q - *cur;
 
-static void read_double_quote(char ** cur, char ** cur_buf) {
-	SKIP_CHAR;
-	while(1) {
-		char c = **cur;
-		switch(c) {
+	if (n <= 16 && end - *cur >= 16)
+		memcpy(*cur_buf, *cur, 16);
+	else
+		memcpy(*cur_buf, *cur, n);
+	*cur_buf += n;
+	*cur += n;
+}
+
+static void read_single_quote(char **cur, char **cur_buf, const char *end)
+{
+	char *q;
+
+	(*cur)++;
+#ifdef __SSE2__
+	if (end - *cur >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)*cur);
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+		q = mask ? *cur + __builtin_ctz(mask) : memchr(*cur + 16, '\'', end - *cur - 16);
+	} else
+#endif
+	q = memchr(*cur, '\'', end - *cur);
+	if (!q) {
+		copy_run(cur, cur_buf, end, end);
+		fprintf(stderr, "Missing closing '\n");
+		return;
+	}
+	copy_run(cur, cur_buf, q, end);
+	(*cur)++;
+}
+
+static void read_double_quote(char **cur, char **cur_buf, const char *end)
+{
+	(*cur)++;
+	while (1) {
+		copy_run(cur, cur_buf, skip_dquoted(*cur, end), end);
+		switch (**cur) {
 		case '"':
-			SKIP_CHAR;
+			(*cur)++;
 			return;
 		case '\\':
-			SKIP_CHAR;
-			READ_CHAR;
+			(*cur)++;
+			if (**cur) *(*cur_buf)++ = *(*cur)++;
 			break;
-                case '\0':
-                        fprintf(stderr, "Missing closing \"\n");
-                        return;
 		default:
-			READ_CHAR;
-			break;
+			fprintf(stderr, "Missing closing \"\n");
+			return;
 		}
 	}
 }
 
-static void read_word(char ** cur, char ** cur_buf) {
-	while(1) {
-		char c = **cur;
-		switch (c) {
-		case '\0':
-		case ' ':
-		case '\t':
-		case '<':
-		case '>':
-		case '|':
-		case '&':
+static void read_word(char **cur, char **cur_buf, const char *end)
+{
+	while (1) {
+		copy_run(cur, cur_buf, skip_ordinary(*cur, end), end);
+		switch (CLASS(**cur)) {
+		case CC_END:
+		case CC_BLANK:
+		case CC_OPERATOR:
 			**cur_buf = '\0';
 			return;
-		case '\'':
-			read_single_quote(cur, cur_buf);
+		case CC_SQUOTE:
+			read_single_quote(cur, cur_buf, end);
 			break;
-		case '"':
-			read_double_quote(cur, cur_buf);
-			break;
-		case '\\':
-			SKIP_CHAR;
-			READ_CHAR;
+		case CC_DQUOTE:
+			read_double_quote(cur, cur_buf, end);
 			break;
-		default:
-			READ_CHAR;
+		case CC_BACKSLASH:
+			(*cur)++;
+			if (**cur) *(*cur_buf)++ = *(*cur)++;
 			break;
 		}
 	}
 }
 
-/* Split the string in words, according to the simple shell grammar. */
-static char **split_in_words(char *line)
+/* Split the string in words, according to the simple shell grammar.
+   (*ops)[i] is set if the word i is an operator: a quoted word never is,
+   whatever its first character. */
+static char **split_in_words(char *line, char **ops)
 {
 	char *cur = line;
-	char *buf = malloc(strlen(line) + 1);
-	char *cur_buf;
+	size_t len = strlen(line);
+	const char *end = line + len;
+	/* The words are stored one after the other in buf: a word and its
+	   terminating null byte never take more room than its characters
+	   in line and the delimiter which follows it. A |N operator is
+	   copied too, with its null byte, while the word before it may have
+	   taken the '|' for its own: two more bytes per '|'. The 16 extra
+	   bytes are for the block copies of copy_run(). */
+	size_t nb_bars = 0;
+	const char *bar;
+	for (bar = strchr(line, '|'); bar; bar = strchr(bar + 1, '|'))
+		nb_bars++;
+	char *buf = arena_alloc(len + 1 + 2 * nb_bars + 16);
+	char *cur_buf = buf;
+	/* A word takes at least one character of the line */
+	char *op = arena_alloc(len + 1);
 	char **tab = 0;
-	size_t l = 0;
+	size_t l = 0, cap = 0;
 	char c;
 
 	while ((c = *cur) != 0) {
 		char *w = 0;
+		op[l] = 1;
 		switch (c) {
 		case ' ':
 		case '\t':
 			/* Ignore any whitespace */
-			cur++;
+			while (CLASS(*++cur) == CC_BLANK)
+				;
 			break;
 		case '&':
 		        w = "&";
@@ -165,98 +426,150 @@ static char **split_in_words(char *line)
 			cur++;
 			break;
 		case '>':
+			if (cur[1] == '+') {
+				w = ">+";
+				cur += 2;
+				break;
+			}
 			w = ">";
 			cur++;
 			break;
 		case '|':
+			if (cur[1] >= '0' && cur[1] <= '9') {
+				/* |N or |Nk, as a whole word: the next command is
+				   replicated. |2to3 is a pipe to 2to3. */
+				char *q = cur + 1;
+				while (*q >= '0' && *q <= '9')
+					q++;
+				if (*q == 'k')
+					q++;
+				if (CLASS(*q) == CC_END || CLASS(*q) == CC_BLANK
+				    || CLASS(*q) == CC_OPERATOR) {
+					w = cur_buf;
+					while (cur < q)
+						*cur_buf++ = *cur++;
+					*cur_buf++ = '\0';
+					break;
+				}
+			}
 			w = "|";
 			cur++;
 			break;
 		default:
 			/* Another word */
-			cur_buf = buf;
-			read_word(&cur, &cur_buf);
-			w = strdup(buf);
+			w = cur_buf;
+			op[l] = 0;
+			read_word(&cur, &cur_buf, end);
+			cur_buf++;
 		}
 		if (w) {
-			tab = xrealloc(tab, (l + 1) * sizeof(char *));
-			tab[l++] = w;
+			tab = (char **)arena_push((void **)tab, &l, &cap, w);
 		}
 	}
-	tab = xrealloc(tab, (l + 1) * sizeof(char *));
-	tab[l++] = 0;
-	free(buf);
+	if (!tab) {
+		tab = arena_alloc(sizeof(char *));
+		tab[0] = 0;
+	}
+	op[l] = 0;
+	*ops = op;
 	return tab;
 }
 
 
-static void freeseq(char ***seq)
-{
-	int i, j;
-
-	for (i=0; seq[i]!=0; i++) {
-		char **cmd = seq[i];
-
-		for (j=0; cmd[j]!=0; j++) free(cmd[j]);
-		free(cmd);
-	}
-	free(seq);
-}
-
+/* Highest number of replicas of a command */
+#define SHARDS_MAX 1024
 
-/* Free the fields of the structure but not the structure itself */
-static void freecmd(struct cmdline *s)
+/* Append the options of a command to the stages array of *len items */
+static struct stage *push_stage(struct stage *stages, size_t *len, size_t *cap,
+				int shards, int ordered)
 {
-	if (s->in) free(s->in);
-	if (s->out) free(s->out);
-	if (s->seq) freeseq(s->seq);
+	if (*len + 1 > *cap) {
+		size_t new_cap = *cap ? 2 * *cap : 8;
+		stages = arena_grow(stages, *cap * sizeof(struct stage),
+				    new_cap * sizeof(struct stage));
+		*cap = new_cap;
+	}
+	stages[*len].shards = shards;
+	stages[*len].ordered = ordered;
+	(*len)++;
+	return stages;
 }
 
-
 struct cmdline *parsecmd(char **pline)
 {
 	char *line = *pline;
 	static struct cmdline *static_cmdline = 0;
 	struct cmdline *s = static_cmdline;
 	char **words;
+	char *ops;
 	int i;
 	char *w;
 	char **cmd;
 	char ***seq;
-	size_t cmd_len, seq_len;
+	size_t cmd_len, seq_len, cmd_cap, seq_cap;
+	struct stage *stages = 0;
+	size_t stages_len = 0, stages_cap = 0;
+	int shards = 1, ordered = 0;	/* Options of the current command */
+	int next_shards, next_ordered;
 
 	if (line == NULL) {
 		if (s) {
-			freecmd(s);
+			arena_free();
 			free(s);
 		}
 		return static_cmdline = 0;
 	}
 
-	cmd = xmalloc(sizeof(char *));
+	/* The previous command line is not used anymore */
+	arena_reset();
+
+	words = split_in_words(line, &ops);
+	free(line);
+	*pline = NULL;
+
+	cmd = arena_alloc(sizeof(char *));
 	cmd[0] = 0;
 	cmd_len = 0;
-	seq = xmalloc(sizeof(char **));
+	cmd_cap = 1;
+	seq = arena_alloc(sizeof(char **));
 	seq[0] = 0;
 	seq_len = 0;
-
-	words = split_in_words(line);
-	free(line);
-	*pline = NULL;
+	seq_cap = 1;
 
 	if (!s)
 		static_cmdline = s = xmalloc(sizeof(struct cmdline));
-	else
-		freecmd(s);
 	s->err = 0;
 	s->in = 0;
 	s->out = 0;
+	s->outs = 0;
 	s->seq = 0;
+	s->stages = 0;
 	s->bg = 0;
+	s->time = 0;
+	s->pipesize = 0;
+	s->timeout = 0;
 
 	i = 0;
+	/* "time" is a keyword only as the first word */
+	if (words[0] != 0 && !strcmp(words[0], "time")) {
+		s->time = 1;
+		i = 1;
+		if (words[1] != 0 && !strcmp(words[1], "-p")) {
+			s->time = 2;
+			i = 2;
+		}
+	}
+	/* So are "pipesize=SPEC" and "timeout=SECONDS", after time */
+	for (; words[i] != 0; i++) {
+		if (!strncmp(words[i], "pipesize=", 9))
+			s->pipesize = words[i] + 9;
+		else if (!strncmp(words[i], "timeout=", 8))
+			s->timeout = words[i] + 8;
+		else
+			break;
+	}
 	while ((w = words[i++]) != 0) {
-		switch (w[0]) {
+		switch (ops[i - 1] ? w[0] : 0) {
 		case '<':
 			/* Tricky : the word can only be "<" */
 			if (s->in) {
@@ -267,20 +580,32 @@ struct cmdline *parsecmd(char **pline)
 				s->err = "filename missing for input redirection";
 				goto error;
 			}
-			switch(words[i][0]){
-			case '<':
-			case '>':
-			case '&':
-			case '|':
-			  s->err = "incorrect filename for input redirection";
-			  goto error;
-			  break;
+			if (ops[i]) {
+				s->err = "incorrect filename for input redirection";
+				goto error;
 			}
 			s->in = words[i++];
 			break;
 		case '>':
+			if (w[1] == '+') {
+				/* >+ and all the words up to the next operator */
+				size_t outs_len = 0, outs_cap = 0;
+				if (s->out || s->outs) {
+					s->err = "only one output file supported";
+					goto error;
+				}
+				while (words[i] != 0 && !ops[i]) {
+					s->outs = (char **)arena_push((void **)s->outs, &outs_len,
+								      &outs_cap, words[i++]);
+				}
+				if (!s->outs) {
+					s->err = "filename missing for output redirection";
+					goto error;
+				}
+				break;
+			}
 			/* Tricky : the word can only be ">" */
-			if (s->out) {
+			if (s->out || s->outs) {
 				s->err = "only one output file supported";
 				goto error;
 			}
@@ -288,14 +613,9 @@ struct cmdline *parsecmd(char **pline)
 				s->err = "filename missing for output redirection";
 				goto error;
 			}
-			switch(words[i][0]){
-			case '<':
-			case '>':
-			case '&':
-			case '|':
-			  s->err = "incorrect filename for output redirection";
-			  goto error;
-			  break;
+			if (ops[i]) {
+				s->err = "incorrect filename for output redirection";
+				goto error;
 			}
 			s->out = words[i++];
 			break;
@@ -321,66 +641,51 @@ struct cmdline *parsecmd(char **pline)
 				s->err = "second command missing for pipe redirection";
 				goto error;
 			}
-			switch(words[i][0]){
-			case '<':
-			case '>':
-			case '&':
-			case '|':
-			  s->err = "incorrect pipe usage";
-			  goto error;
-			  break;
+			if (ops[i]) {
+				s->err = "incorrect pipe usage";
+				goto error;
+			}
+			next_shards = 1;
+			next_ordered = 0;
+			if (w[1]) {
+				char *end;
+				long n = strtol(w + 1, &end, 10);
+				if (n < 1 || n > SHARDS_MAX) {
+					s->err = "incorrect number of replicas";
+					goto error;
+				}
+				next_shards = n;
+				next_ordered = (*end == 'k');
 			}
-			seq = xrealloc(seq, (seq_len + 2) * sizeof(char **));
-			seq[seq_len++] = cmd;
-			seq[seq_len] = 0;
+			seq = (char ***)arena_push((void **)seq, &seq_len, &seq_cap, cmd);
+			stages = push_stage(stages, &stages_len, &stages_cap, shards, ordered);
+			shards = next_shards;
+			ordered = next_ordered;
 
-			cmd = xmalloc(sizeof(char *));
+			cmd = arena_alloc(sizeof(char *));
 			cmd[0] = 0;
 			cmd_len = 0;
+			cmd_cap = 1;
 			break;
 		default:
-			cmd = xrealloc(cmd, (cmd_len + 2) * sizeof(char *));
-			cmd[cmd_len++] = w;
-			cmd[cmd_len] = 0;
+			cmd = (char **)arena_push((void **)cmd, &cmd_len, &cmd_cap, w);
 		}
 	}
 
 	if (cmd_len != 0) {
-		seq = xrealloc(seq, (seq_len + 2) * sizeof(char **));
-		seq[seq_len++] = cmd;
-		seq[seq_len] = 0;
+		seq = (char ***)arena_push((void **)seq, &seq_len, &seq_cap, cmd);
+		stages = push_stage(stages, &stages_len, &stages_cap, shards, ordered);
 	} else if (seq_len != 0) {
 		s->err = "misplaced pipe";
-		i--;
 		goto error;
-	} else
-		free(cmd);
-	free(words);
+	}
 	s->seq = seq;
+	s->stages = stages;
 	return s;
 error:
-	while ((w = words[i++]) != 0) {
-		switch (w[0]) {
-		case '&':
-		case '<':
-		case '>':
-		case '|':
-			break;
-		default:
-			free(w);
-		}
-	}
-	free(words);
-	freeseq(seq);
-	for (i=0; cmd[i]!=0; i++) free(cmd[i]);
-	free(cmd);
-	if (s->in) {
-		free(s->in);
-		s->in = 0;
-	}
-	if (s->out) {
-		free(s->out);
-		s->out = 0;
-	}
+	/* The words stay in the arena until the next command line */
+	s->in = 0;
+	s->out = 0;
+	s->outs = 0;
 	return s;
 }
@@ -19,7 +19,9 @@
 
 /* Read a command line from input stream. Return null when input closed.
 Display an error and call exit() in case of memory exhaustion. 
-It frees also line and set it at NULL */
+It frees also line and set it at NULL.
+The returned structure and all its strings live in an arena which is
+reset by the next call: copy what must outlive the command line. */
 struct cmdline *parsecmd(char **line);
 
 
@@ -39,8 +41,25 @@ struct cmdline {
 			   displayed. The other fields are null. */
 	char *in;	/* If not null : name of file for input redirection. */
 	char *out;	/* If not null : name of file for output redirection. */
+	char **outs;	/* If not null : null terminated array of the files
+			   which all get the output (>+ file...). */
         int   bg;       /* If set the command must run in background */ 
+	int   time;	/* If set the resource usage must be reported (time
+			   prefix): 1, or 2 for the POSIX format (time -p) */
+	char *pipesize;	/* If not null : options of the pipes between the
+			   commands (pipesize=SPEC prefix), see pipes.h */
+	char *timeout;	/* If not null : wall clock limit of the command
+			   line in seconds (timeout=SECONDS prefix) */
 	char ***seq;	/* See comment below */
+	struct stage *stages;	/* stages[i] gives the options of seq[i] */
+};
+
+/* Options of a command of the sequence */
+struct stage {
+	int shards;	/* Number of replicas of the command (|N before it), 1
+			   normally. They share its input, split on line
+			   boundaries, and their outputs are merged. */
+	int ordered;	/* If set the merged output keeps the input order (|Nk) */
 };
 
 /* Field seq of struct cmdline :
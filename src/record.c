@@ -0,0 +1,61 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "record.h"
+#include "stats.h"
+
+static FILE* out = NULL;
+static char* pending = NULL;    // Line being run, not recorded yet
+static uint64_t origin;         // Start of the session
+static uint64_t started;        // Reading of the pending line
+
+int record_open(const char* path) {
+    out = fopen(path, "a");
+    if (out == NULL) {
+        return -1;
+    }
+    // Whole lines: the forked copies of the shell have nothing to flush
+    setvbuf(out, NULL, _IOLBF, 0);
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    origin = stats_now();
+    fprintf(out, "# ensishell record %ld.%06ld\n", (long)now.tv_sec, now.tv_nsec / 1000);
+    return 0;
+}
+
+void record_line(const char* line) {
+    if (out == NULL) {
+        return;
+    }
+    free(pending);
+    // parsecmd() frees the line
+    pending = strdup(line);
+    started = stats_now();
+}
+
+void record_end(int status) {
+    if (pending == NULL) {
+        return;
+    }
+    uint64_t end = stats_now();
+    fprintf(out, "%.6f\t%.6f\t%d\t%s\n", (started - origin) / 1e9, (end - started) / 1e9,
+            status, pending);
+    free(pending);
+    pending = NULL;
+}
+
+void record_close(void) {
+    free(pending);
+    pending = NULL;
+    if (out != NULL) {
+        fclose(out);
+        out = NULL;
+    }
+}
@@ -0,0 +1,31 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __RECORD_H
+#define __RECORD_H
+
+/*
+ * Record of a session (ensishell --record FILE), replayed by bench/replay.
+ * After a "# ensishell record EPOCH" header, each input line gives:
+ *   OFFSET<TAB>DURATION<TAB>STATUS<TAB>LINE
+ * OFFSET is the time when the line was read since the start of the
+ * session and DURATION the time it took, in seconds; STATUS is the exit
+ * status of the shell after it.
+ */
+
+/* Append the record of the session to path. Return -1 with errno set if
+   it cannot be opened. */
+int record_open(const char* path);
+
+/* The shell just read line: ends the record of the previous line */
+void record_line(const char* line);
+
+/* The current line is done, with the exit status status */
+void record_end(int status);
+
+/* Flush and close the record. A line not ended is not recorded. */
+void record_close(void);
+
+#endif
@@ -0,0 +1,114 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "script.h"
+
+#define SCRIPT_BUFSIZE (256 * 1024)
+
+struct script {
+    int fd;         // -1 once the whole input is in buf
+    char* buf;
+    size_t size;
+    size_t start;   // First byte of the next line
+    size_t scanned; // Bytes after start known not to be '\n'
+    size_t end;     // End of the bytes read
+};
+
+struct script* script_open(const char* path) {
+    int fd = 0;
+    if (strcmp(path, "-") != 0) {
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return NULL;
+        }
+    }
+    struct script* s = malloc(sizeof(struct script));
+    s->fd = fd;
+    s->size = SCRIPT_BUFSIZE;
+    s->buf = malloc(s->size);
+    s->start = s->scanned = s->end = 0;
+    return s;
+}
+
+struct script* script_from_string(const char* text) {
+    struct script* s = malloc(sizeof(struct script));
+    s->fd = -1;
+    s->end = s->size = strlen(text);
+    s->buf = malloc(s->size + 1);
+    memcpy(s->buf, text, s->size);
+    s->start = s->scanned = 0;
+    return s;
+}
+
+// Read more input after the pending bytes, return 0 at the end of input
+static int script_fill(struct script* s) {
+    if (s->fd == -1) {
+        return 0;
+    }
+    if (s->start > 0) {
+        memmove(s->buf, s->buf + s->start, s->end - s->start);
+        s->end -= s->start;
+        s->start = 0;
+    }
+    if (s->end == s->size) {
+        // A line longer than the buffer
+        s->size *= 2;
+        s->buf = realloc(s->buf, s->size);
+    }
+    ssize_t n;
+    do {
+        n = read(s->fd, s->buf + s->end, s->size - s->end);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) {
+        if (s->fd != 0) {
+            close(s->fd);
+        }
+        s->fd = -1;
+        return 0;
+    }
+    s->end += n;
+    return 1;
+}
+
+static char* script_take(struct script* s, size_t len, size_t skip) {
+    char* line = malloc(len + 1);
+    memcpy(line, s->buf + s->start, len);
+    line[len] = '\0';
+    s->start += len + skip;
+    s->scanned = 0;
+    return line;
+}
+
+char* script_read_line(struct script* s) {
+    while (1) {
+        char* from = s->buf + s->start + s->scanned;
+        char* nl = memchr(from, '\n', s->end - s->start - s->scanned);
+        if (nl != NULL) {
+            return script_take(s, nl - (s->buf + s->start), 1);
+        }
+        s->scanned = s->end - s->start;
+        if (!script_fill(s)) {
+            if (s->start == s->end) {
+                return NULL;
+            }
+            // Last line without '\n'
+            return script_take(s, s->end - s->start, 0);
+        }
+    }
+}
+
+void script_close(struct script* s) {
+    if (s->fd > 0) {
+        close(s->fd);
+    }
+    free(s->buf);
+    free(s);
+}
@@ -0,0 +1,27 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __SCRIPT_H
+#define __SCRIPT_H
+
+/* Line reader of the batch mode (ensishell script, ensishell -c text).
+   The input is read by big read(2) calls and split with memchr, no
+   stdio nor readline is involved. */
+struct script;
+
+/* Open the script file path, "-" for the standard input.
+   Return NULL and set errno on failure. */
+struct script* script_open(const char* path);
+
+/* Lines of text, as given to ensishell -c */
+struct script* script_from_string(const char* text);
+
+/* Return the next line without its '\n', in a malloc'ed string that
+   parsecmd() frees, or NULL at the end of the input */
+char* script_read_line(struct script* s);
+
+void script_close(struct script* s);
+
+#endif
@@ -0,0 +1,352 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "shard.h"
+
+#define SHARD_READ (64 * 1024)      // Bytes read at once from a pipe
+
+struct buffer {
+    char* data;
+    size_t len;
+    size_t cap;
+};
+
+struct worker {
+    pid_t pid;              // 0: free slot
+    int in;                 // Write end of its standard input, -1 once closed
+    int out;                // Read end of its standard output, -1 at its end
+    struct buffer input;    // Lines not written to in yet
+    struct buffer output;   // Output not written downstream yet
+};
+
+// Set by shard_launch() before the fork
+static int nb_shards;
+static int keep_order;
+
+// Room for len more bytes at the end of b
+static void buffer_reserve(struct buffer* b, size_t len) {
+    if (b->cap - b->len < len) {
+        while (b->cap - b->len < len) {
+            b->cap = b->cap ? 2 * b->cap : SHARD_READ;
+        }
+        b->data = realloc(b->data, b->cap);
+    }
+}
+
+static void buffer_append(struct buffer* b, const char* data, size_t len) {
+    buffer_reserve(b, len);
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+// Drop the first len bytes of b
+static void buffer_consume(struct buffer* b, size_t len) {
+    memmove(b->data, b->data + len, b->len - len);
+    b->len -= len;
+}
+
+// Length of b up to its last '\n' included, 0 if there is none
+static size_t buffer_lines(struct buffer* b) {
+    char* nl = b->len ? memrchr(b->data, '\n', b->len) : NULL;
+    return nl ? nl - b->data + 1 : 0;
+}
+
+// Write len bytes downstream, exit if it is gone
+static void write_out(const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(1, data, len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            // Like a killed stage: the replicas get SIGPIPE in turn
+            _exit(128 + SIGPIPE);
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+// Launch a replica of argv in the free slot w
+static int worker_start(struct worker* w, char** argv) {
+    int to[2], from[2];
+    if (pipe2(to, O_CLOEXEC) == -1) {
+        return 0;
+    }
+    if (pipe2(from, O_CLOEXEC) == -1) {
+        close(to[0]);
+        close(to[1]);
+        return 0;
+    }
+    struct launch p;
+    launch_init(&p, argv);
+    p.fd_in = to[0];
+    p.fd_out = from[1];
+    p.pgid = getpgrp();
+    pid_t pid = launch(&p);
+    close(to[0]);
+    close(from[1]);
+    if (pid == -1) {
+        int err = errno;
+        close(to[1]);
+        close(from[0]);
+        errno = err;
+        return 0;
+    }
+    // The helper never blocks on a replica which does not read
+    fcntl(to[1], F_SETFL, O_NONBLOCK);
+    w->pid = pid;
+    w->in = to[1];
+    w->out = from[0];
+    w->input.len = 0;
+    w->output.len = 0;
+    return 1;
+}
+
+// Wait for the replica and free its slot. Keep the first failure in *status.
+static void worker_reap(struct worker* w, int* status) {
+    int s;
+    if (waitpid(w->pid, &s, 0) == w->pid && *status == 0) {
+        if (WIFEXITED(s)) {
+            *status = WEXITSTATUS(s);
+        } else if (WIFSIGNALED(s)) {
+            *status = 128 + WTERMSIG(s);
+        }
+    }
+    if (w->in != -1) {
+        close(w->in);
+        w->in = -1;
+    }
+    w->pid = 0;
+}
+
+// Kill the replicas started before a failure and wait for them
+static void worker_abort(struct worker* workers) {
+    int status = 0;
+    for (int i = 0; i < nb_shards; i++) {
+        if (workers[i].pid != 0) {
+            kill(workers[i].pid, SIGKILL);
+            worker_reap(&workers[i], &status);
+        }
+    }
+}
+
+// Number of lines of the len bytes at data, the last one may be partial
+static size_t count_lines(const char* data, size_t len) {
+    size_t n = 0;
+    const char* end = data + len;
+    const char* nl;
+    while ((nl = memchr(data, '\n', end - data)) != NULL) {
+        n++;
+        data = nl + 1;
+    }
+    return n + (data < end);
+}
+
+// Ordered mode: write downstream the outputs of the chunks, in order, as
+// long as they are complete. lines holds the number of lines of each chunk
+// not written yet, from *next_emit on, which went to the replica number
+// chunk % nb_shards.
+static void emit_ordered(struct worker* workers, struct buffer* lines, long* next_emit) {
+    while (lines->len != 0) {
+        struct worker* w = &workers[*next_emit % nb_shards];
+        size_t need;
+        memcpy(&need, lines->data, sizeof(need));
+        size_t len = 0;
+        const char* nl;
+        while (need > 0
+               && (nl = memchr(w->output.data + len, '\n', w->output.len - len)) != NULL) {
+            len = nl + 1 - w->output.data;
+            need--;
+        }
+        if (need > 0 && w->out == -1) {
+            // The replica ended: what it wrote is all the chunk gets
+            len = w->output.len;
+            need = 0;
+        }
+        write_out(w->output.data, len);
+        buffer_consume(&w->output, len);
+        if (need > 0) {
+            memcpy(lines->data, &need, sizeof(need));
+            return;
+        }
+        buffer_consume(lines, sizeof(need));
+        (*next_emit)++;
+    }
+}
+
+static int shard_main(char** argv) {
+    struct worker* workers = calloc(nb_shards, sizeof(struct worker));
+    struct buffer carry = {NULL, 0, 0};    // Input not given to a replica yet
+    struct buffer lines = {NULL, 0, 0};    // Ordered mode, see emit_ordered()
+    int eof = 0;
+    int status = 0;
+    int next = 0;           // Round-robin position
+    long next_emit = 0;     // Ordered mode: chunk whose output goes downstream
+
+    // A replica may stop reading: write() then fails with EPIPE
+    signal(SIGPIPE, SIG_IGN);
+    for (int i = 0; i < nb_shards; i++) {
+        workers[i].in = workers[i].out = -1;
+    }
+    for (int i = 0; i < nb_shards; i++) {
+        if (!worker_start(&workers[i], argv)) {
+            fprintf(stderr, "[ERROR] %s: %s\n", argv[0], strerror(errno));
+            worker_abort(workers);
+            return 127;
+        }
+    }
+
+    struct pollfd fds[2 * nb_shards + 1];
+    struct worker* owners[2 * nb_shards + 1];
+    while (1) {
+        // Hand the complete lines over to the idle replicas. In ordered
+        // mode they take their turn whether busy or not, the one which
+        // stopped reading too: its chunk is dropped.
+        for (int k = 0; k < nb_shards; k++) {
+            size_t len = buffer_lines(&carry);
+            if (eof && len == 0) {
+                len = carry.len;
+            }
+            if (len == 0) {
+                break;
+            }
+            struct worker* w = &workers[(next + k) % nb_shards];
+            if (w->in != -1 && w->input.len != 0) {
+                if (keep_order) {
+                    break;
+                }
+                continue;
+            }
+            if (keep_order) {
+                size_t n = count_lines(carry.data, len);
+                buffer_append(&lines, (char*)&n, sizeof(n));
+            } else if (w->in == -1) {
+                continue;
+            }
+            if (w->in != -1) {
+                buffer_append(&w->input, carry.data, len);
+            }
+            buffer_consume(&carry, len);
+            next = (next + k + 1) % nb_shards;
+            k = -1;
+        }
+        // Nothing more will come to the replicas: they can end
+        for (int k = 0; k < nb_shards; k++) {
+            struct worker* w = &workers[k];
+            if (w->in != -1 && w->input.len == 0 && eof && carry.len == 0) {
+                close(w->in);
+                w->in = -1;
+            }
+        }
+
+        int nfds = 0;
+        if (!eof && (carry.len < SHARD_READ || buffer_lines(&carry) == 0)) {
+            fds[nfds].fd = 0;
+            fds[nfds].events = POLLIN;
+            owners[nfds++] = NULL;
+        }
+        for (int k = 0; k < nb_shards; k++) {
+            struct worker* w = &workers[k];
+            if (w->in != -1 && w->input.len != 0) {
+                fds[nfds].fd = w->in;
+                fds[nfds].events = POLLOUT;
+                owners[nfds++] = w;
+            }
+            if (w->out != -1) {
+                fds[nfds].fd = w->out;
+                fds[nfds].events = POLLIN;
+                owners[nfds++] = w;
+            }
+        }
+        if (nfds == 0) {
+            break;
+        }
+        if (poll(fds, nfds, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[ERROR] poll");
+            return 1;
+        }
+
+        for (int i = 0; i < nfds; i++) {
+            struct worker* w = owners[i];
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            if (w == NULL) {
+                // Upstream input
+                buffer_reserve(&carry, SHARD_READ);
+                ssize_t n = read(0, carry.data + carry.len, SHARD_READ);
+                if (n > 0) {
+                    carry.len += n;
+                } else if (n == 0 || errno != EINTR) {
+                    eof = 1;
+                }
+            } else if (fds[i].fd == w->in) {
+                ssize_t n = write(w->in, w->input.data, w->input.len);
+                if (n > 0) {
+                    buffer_consume(&w->input, n);
+                } else if (errno != EAGAIN && errno != EINTR) {
+                    // The replica does not read anymore
+                    w->input.len = 0;
+                    close(w->in);
+                    w->in = -1;
+                }
+            } else {
+                buffer_reserve(&w->output, SHARD_READ);
+                ssize_t n = read(w->out, w->output.data + w->output.len, SHARD_READ);
+                if (n == -1 && errno == EINTR) {
+                    continue;
+                }
+                if (n > 0) {
+                    w->output.len += n;
+                } else {
+                    close(w->out);
+                    w->out = -1;
+                }
+                if (keep_order) {
+                    emit_ordered(workers, &lines, &next_emit);
+                } else {
+                    // Whole lines only, they must not be mixed, but all of
+                    // it at the end of the replica
+                    size_t len = w->out == -1 ? w->output.len : buffer_lines(&w->output);
+                    write_out(w->output.data, len);
+                    buffer_consume(&w->output, len);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < nb_shards; i++) {
+        if (workers[i].pid != 0) {
+            worker_reap(&workers[i], &status);
+        }
+        free(workers[i].input.data);
+        free(workers[i].output.data);
+    }
+    free(workers);
+    free(carry.data);
+    free(lines.data);
+    return status;
+}
+
+pid_t shard_launch(struct launch* p, int shards, int ordered) {
+    nb_shards = shards;
+    keep_order = ordered;
+    return launch_function(p, shard_main);
+}
@@ -0,0 +1,28 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __SHARD_H
+#define __SHARD_H
+
+#include <sys/types.h>
+
+#include "launcher.h"
+
+/* Launch a replicated pipeline stage (|N command): a forked copy of the
+   shell, set up like launch_function() does, which starts shards
+   replicas of p->argv and dispatches the lines of its standard input to
+   them, round-robin by chunks, merging their outputs on its standard
+   output.
+   The replicas run as long as the input, and the merged output is made
+   of whole lines in no particular order. If ordered is set, the chunks
+   go to the replicas in turn, and as many lines as a chunk had are taken
+   back from the output of its replica in the same turn: the input order
+   is kept for a command which writes one line per line it reads (tr,
+   cut, sed s///...).
+   It exits with the first non-zero status of the replicas.
+   Return the pid of the helper, or -1 with errno set. */
+pid_t shard_launch(struct launch* p, int shards, int ordered);
+
+#endif
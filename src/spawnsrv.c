@@ -0,0 +1,300 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "spawnsrv.h"
+
+#define SPAWN_MSG_MAX (128 * 1024)  // Largest request: argv and environment
+#define SPAWN_FDS 5                 // stdin, stdout, stderr, cwd, terminal
+
+extern char** environ;
+
+struct request {
+    pid_t pgid;         // Process group to join, 0 to create a new one
+    int tty;            // If set the last descriptor is the terminal to give
+    int argc;
+    int envc;
+    int has_in;         // If set the strings have an input file after the path
+    int has_out;        // Same for the output file
+    // Then the strings: path, in, out, argv, environment
+};
+
+struct reply {
+    pid_t pid;
+    int err;
+};
+
+static int server_fd = -1;  // Socket of the shell, -1 without server
+static pid_t owner = 0;     // Process which started the server
+
+// Child of the shell created by the server: set up as described by r and exec
+static void serve_child(struct request* r, char** strings, int* fds, int nb_fds, int report) {
+    char* path = strings[0];
+    char* in = r->has_in ? strings[1] : NULL;
+    char* out = r->has_out ? strings[1 + r->has_in] : NULL;
+    char** argv = strings + 1 + r->has_in + r->has_out;
+    char** env = argv + r->argc + 1;
+
+    setpgid(0, r->pgid);
+    if (r->tty) {
+        // SIGTTOU is still ignored, as in the server
+        tcsetpgrp(fds[nb_fds - 1], getpgrp());
+    }
+    for (int sig = 1; sig < NSIG; sig++) {
+        signal(sig, SIG_DFL);
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+
+    int err = 0;
+    if (fchdir(fds[3]) == -1 || dup2(fds[0], 0) == -1 || dup2(fds[1], 1) == -1
+        || dup2(fds[2], 2) == -1) {
+        err = errno;
+    }
+    if (err == 0 && in != NULL) {
+        int f = open(in, O_RDONLY);
+        if (f == -1 || dup2(f, 0) == -1) {
+            err = errno;
+        }
+        close(f);
+    }
+    if (err == 0 && out != NULL) {
+        int f = open(out, O_WRONLY | O_TRUNC | O_CREAT, 0644);
+        if (f == -1 || dup2(f, 1) == -1) {
+            err = errno;
+        }
+        close(f);
+    }
+    if (err == 0) {
+        execve(path, argv, env);
+        err = errno;
+    }
+    // The close-on-exec report pipe is only written on failure
+    if (write(report, &err, sizeof(err)) != sizeof(err)) {
+        _exit(126);
+    }
+    _exit(127);
+}
+
+// Handle the request of n bytes in buf, with its descriptors
+static struct reply serve_request(char* buf, size_t n, int* fds, int nb_fds) {
+    struct reply reply = {-1, EINVAL};
+    struct request* r = (struct request*)buf;
+    if (n < sizeof(*r) || nb_fds < 4 || nb_fds != 4 + (r->tty != 0)) {
+        return reply;
+    }
+
+    // Cut the strings, the request being null terminated by the shell
+    int nb_strings = 1 + r->has_in + r->has_out + r->argc + r->envc;
+    char* strings[nb_strings + 2];
+    char* cur = buf + sizeof(*r);
+    for (int i = 0; i < nb_strings + 2; i++) {
+        if (i == 1 + r->has_in + r->has_out + r->argc || i == nb_strings + 1) {
+            strings[i] = NULL;  // End of argv, end of the environment
+            continue;
+        }
+        if (cur >= buf + n) {
+            return reply;
+        }
+        strings[i] = cur;
+        cur += strlen(cur) + 1;
+    }
+
+    int report[2];
+    if (pipe2(report, O_CLOEXEC) == -1) {
+        reply.err = errno;
+        return reply;
+    }
+    // Like fork(), but the new process is a child of the shell
+    pid_t pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+    if (pid == 0) {
+        close(report[0]);
+        serve_child(r, strings, fds, nb_fds, report[1]);
+    }
+    close(report[1]);
+    if (pid == -1) {
+        reply.err = errno;
+    } else {
+        int err = 0;
+        ssize_t got;
+        do {
+            got = read(report[0], &err, sizeof(err));
+        } while (got == -1 && errno == EINTR);
+        // Nothing to read: the exec succeeded
+        reply.pid = pid;
+        reply.err = (got == sizeof(err)) ? err : 0;
+    }
+    close(report[0]);
+    return reply;
+}
+
+static void serve(int sock) {
+    char* buf = malloc(SPAWN_MSG_MAX);
+    char control[CMSG_SPACE(SPAWN_FDS * sizeof(int))];
+
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+    while (1) {
+        struct iovec iov = {buf, SPAWN_MSG_MAX - 1};
+        struct msghdr msg = {0};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // The shell is gone
+            _exit(0);
+        }
+        buf[n] = '\0';
+
+        int fds[SPAWN_FDS];
+        int nb_fds = 0;
+        struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+        if (c != NULL && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+            nb_fds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(c), nb_fds * sizeof(int));
+        }
+        struct reply reply = serve_request(buf, n, fds, nb_fds);
+        for (int i = 0; i < nb_fds; i++) {
+            close(fds[i]);
+        }
+        if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+            _exit(0);
+        }
+    }
+}
+
+int spawn_server_start(void) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == -1) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        serve(sv[1]);
+    }
+    close(sv[1]);
+    server_fd = sv[0];
+    owner = getpid();
+    return 0;
+}
+
+void spawn_server_stop(void) {
+    if (server_fd != -1) {
+        close(server_fd);
+        server_fd = -1;
+    }
+}
+
+// Append s and its null byte at *cur, if it fits before end
+static int put_string(char** cur, char* end, const char* s) {
+    size_t len = strlen(s) + 1;
+    if ((size_t)(end - *cur) < len) {
+        return 0;
+    }
+    memcpy(*cur, s, len);
+    *cur += len;
+    return 1;
+}
+
+int spawn_server_spawn(const char* path, struct launch* p, pid_t* pid) {
+    static char* buf = NULL;
+    // The socket is closed in the forked copies of the shell
+    if (server_fd == -1 || getpid() != owner) {
+        return -1;
+    }
+    if (buf == NULL) {
+        buf = malloc(SPAWN_MSG_MAX);
+    }
+
+    struct request* r = (struct request*)buf;
+    r->pgid = p->pgid;
+    r->tty = p->foreground && isatty(0) && tcgetpgrp(0) == getpgrp();
+    r->argc = 0;
+    r->envc = 0;
+    r->has_in = (p->in != NULL);
+    r->has_out = (p->out != NULL);
+    char* cur = buf + sizeof(*r);
+    char* end = buf + SPAWN_MSG_MAX - 1;
+    int fits = put_string(&cur, end, path);
+    if (p->in) {
+        fits &= put_string(&cur, end, p->in);
+    }
+    if (p->out) {
+        fits &= put_string(&cur, end, p->out);
+    }
+    for (; fits && p->argv[r->argc] != NULL; r->argc++) {
+        fits = put_string(&cur, end, p->argv[r->argc]);
+    }
+    for (; fits && environ[r->envc] != NULL; r->envc++) {
+        fits = put_string(&cur, end, environ[r->envc]);
+    }
+    if (!fits) {
+        return -1;
+    }
+
+    int fds[SPAWN_FDS] = {p->fd_in != -1 ? p->fd_in : 0, p->fd_out != -1 ? p->fd_out : 1,
+                          p->fd_err != -1 ? p->fd_err : 2, -1, 0};
+    fds[3] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fds[3] == -1) {
+        return -1;
+    }
+    int nb_fds = 4 + r->tty;
+    char control[CMSG_SPACE(SPAWN_FDS * sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {buf, cur - buf};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(nb_fds * sizeof(int));
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(nb_fds * sizeof(int));
+    memcpy(CMSG_DATA(c), fds, nb_fds * sizeof(int));
+
+    ssize_t sent = sendmsg(server_fd, &msg, MSG_NOSIGNAL);
+    close(fds[3]);
+    struct reply reply;
+    ssize_t got = -1;
+    if (sent == cur - buf) {
+        do {
+            got = recv(server_fd, &reply, sizeof(reply), 0);
+        } while (got == -1 && errno == EINTR);
+    }
+    if (got != sizeof(reply)) {
+        // The server died: launch without it from now on
+        spawn_server_stop();
+        return -1;
+    }
+    *pid = reply.pid;
+    return reply.err;
+}
@@ -0,0 +1,34 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __SPAWNSRV_H
+#define __SPAWNSRV_H
+
+#include <sys/types.h>
+
+#include "launcher.h"
+
+/*
+ * Spawn server: a small process forked when the shell starts, before
+ * Guile and its heap are loaded, which launches the commands for it.
+ * A request carries the path, argv, redirections, environment and
+ * current directory of the command over a UNIX socketpair, and the
+ * standard streams to use as SCM_RIGHTS descriptors. The server creates
+ * the process with clone(CLONE_PARENT): it is a child of the shell, which
+ * reaps it as usual, but its creation never copies the shell.
+ */
+
+/* Fork the server. Return 0, or -1 with errno set. */
+int spawn_server_start(void);
+
+/* Stop the server, the commands are launched by the shell again */
+void spawn_server_stop(void);
+
+/* Launch path as described by p through the server. Return -1 if the
+   server cannot be used (not started, forked copy of the shell, request
+   too big), otherwise 0 with *pid set, or the errno value of the failure. */
+int spawn_server_spawn(const char* path, struct launch* p, pid_t* pid);
+
+#endif
@@ -0,0 +1,107 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+#define SUB_BITS 3
+#define SUB (1 << SUB_BITS)
+#define NB_BUCKETS (SUB * (64 - SUB_BITS + 1))
+
+struct histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[NB_BUCKETS];
+};
+
+static struct histogram histograms[STAT_COUNT];
+
+static const char* names[STAT_COUNT] = {
+    "read", "parse", "spawn", "fork", "builtin", "wait",
+};
+
+// Values below SUB have their own bucket, then SUB buckets per power of two
+static unsigned bucket_of(uint64_t v) {
+    if (v < SUB) {
+        return v;
+    }
+    unsigned msb = 63 - __builtin_clzll(v);
+    return SUB * (msb - SUB_BITS + 1) + ((v >> (msb - SUB_BITS)) & (SUB - 1));
+}
+
+// Highest value counted in bucket i
+static uint64_t bucket_max(unsigned i) {
+    if (i < SUB) {
+        return i;
+    }
+    unsigned msb = i / SUB + SUB_BITS - 1;
+    uint64_t low = (uint64_t)(SUB + i % SUB) << (msb - SUB_BITS);
+    return low + ((uint64_t)1 << (msb - SUB_BITS)) - 1;
+}
+
+void stats_add(enum stat_id id, uint64_t ns) {
+    struct histogram* h = &histograms[id];
+    h->count++;
+    h->sum += ns;
+    if (ns > h->max) {
+        h->max = ns;
+    }
+    h->buckets[bucket_of(ns)]++;
+}
+
+// Value under which the fraction q of the samples are
+static uint64_t percentile(struct histogram* h, double q) {
+    uint64_t rank = q * h->count;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < NB_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen > rank) {
+            uint64_t v = bucket_max(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+void stats_print(FILE* f) {
+    fprintf(f, "%-8s %10s %10s %10s %10s %10s %10s\n",
+            "", "count", "mean us", "p50 us", "p90 us", "p99 us", "max us");
+    for (int id = 0; id < STAT_COUNT; id++) {
+        struct histogram* h = &histograms[id];
+        if (h->count == 0) {
+            fprintf(f, "%-8s %10d\n", names[id], 0);
+            continue;
+        }
+        fprintf(f, "%-8s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", names[id],
+                (unsigned long long)h->count, h->sum / 1e3 / h->count,
+                percentile(h, 0.5) / 1e3, percentile(h, 0.9) / 1e3,
+                percentile(h, 0.99) / 1e3, h->max / 1e3);
+    }
+}
+
+void stats_dump(void) {
+    char* path = getenv("ENSISHELL_STATS");
+    FILE* f = path ? fopen(path, "w") : NULL;
+    if (f != NULL) {
+        stats_print(f);
+        fclose(f);
+    }
+}
+
+int stats_builtin(char** argv) {
+    if (argv[1] != NULL && !strcmp(argv[1], "-r") && argv[2] == NULL) {
+        memset(histograms, 0, sizeof(histograms));
+        return 0;
+    }
+    if (argv[1] != NULL) {
+        fprintf(stderr, "stats: usage: stats [-r]\n");
+        return 2;
+    }
+    stats_print(stdout);
+    return 0;
+}
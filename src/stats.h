@@ -0,0 +1,49 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * Latency histograms of the main loop of the shell, always on. A sample
+ * costs two reads of the monotonic clock (vDSO) and an increment: values
+ * are counted in log buckets of 8 sub-buckets per power of two, so the
+ * percentiles are within 12.5%, like a HDR histogram of 3 bits.
+ */
+
+enum stat_id {
+    STAT_READ,      /* Wait for the next line (readline or script) */
+    STAT_PARSE,     /* parsecmd() */
+    STAT_SPAWN,     /* launch(): posix_spawn returns once the child exec'd */
+    STAT_FORK,      /* launch_function(): fork of a copy of the shell */
+    STAT_BUILTIN,   /* Builtin run in the shell */
+    STAT_WAIT,      /* Wait for a foreground job to end or stop */
+    STAT_COUNT,
+};
+
+/* Monotonic time in nanoseconds */
+static inline uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Count a sample of ns nanoseconds */
+void stats_add(enum stat_id id, uint64_t ns);
+
+/* Print count, mean, p50, p90, p99 and max of every histogram */
+void stats_print(FILE* f);
+
+/* Write the statistics to the file named by $ENSISHELL_STATS, if set */
+void stats_dump(void);
+
+/* stats [-r]: print the statistics, or reset them */
+int stats_builtin(char** argv);
+
+#endif
@@ -19,3 +19,6 @@ require '../tests/testPrompt'
 require '../tests/testForkExec'
 require '../tests/testInOut'
 require '../tests/testJobs'
+require '../tests/testBatch'
+require '../tests/testBuiltins'
+require '../tests/testScheme'
@@ -0,0 +1,109 @@
+# -*- coding: utf-8 -*-
+require "minitest/autorun"
+require "open3"
+
+require "../tests/testConstantes"
+
+class Test4Batch < Minitest::Test
+  test_order=:defined
+
+  def teardown
+    system("rm -f totoScript.sh")
+  end
+
+  def test_option_c
+    sortie = `#{COMMANDESHELL} -c 'echo toto | tr a-z A-Z'`
+    assert_equal("TOTO\n", sortie, "ensishell -c ne doit afficher que la sortie de la commande")
+  end
+
+  def test_script
+    File.write("totoScript.sh", "#!/bin/ensishell\necho un\n\necho deux\nfalse\n")
+    sortie = `#{COMMANDESHELL} totoScript.sh`
+    assert_equal("un\ndeux\n", sortie, "le script n'a pas été exécuté ligne par ligne")
+    assert_equal(1, $?.exitstatus, "le code de retour doit être celui de la dernière commande")
+  end
+
+  def test_shards
+    sortie = `#{COMMANDESHELL} -c "printf '%s\\n' 3 1 2 4 |2 tr 0-9 a-j | sort"`
+    assert_equal("b\nc\nd\ne\n", sortie, "|2 doit répartir les lignes entre deux copies de la commande")
+    sortie = `#{COMMANDESHELL} -c "printf '%s\\n' 3 1 2 4 |3k cat"`
+    assert_equal("3\n1\n2\n4\n", sortie, "|3k doit garder l'ordre des lignes")
+    # Les répliques servent tour à tour pour tous les morceaux de l'entrée
+    sortie = `#{COMMANDESHELL} -c "seq 1 200000 |3k tr 0-9 a-j"`
+    assert_equal((1..200000).map { |i| i.to_s.tr("0-9", "a-j") + "\n" }.join, sortie,
+                 "|3k doit garder l'ordre d'une entrée de plusieurs morceaux")
+  end
+
+  def test_shards_sans_blanc
+    # Chaque |N collé au mot d'avant prend plus de place que dans la ligne
+    sortie = `#{COMMANDESHELL} -c "echo a#{"|2 cat" * 60}"`
+    assert_equal(0, $?.exitstatus, "une longue ligne de |N sans blanc ne doit pas planter le shell")
+    assert_equal("a\n", sortie, "a|2 cat|2 cat... doit afficher la ligne")
+  end
+
+  def test_shards_mot_entier
+    sortie = `#{COMMANDESHELL} -c "echo '|2' cat"`
+    assert_equal("|2 cat\n", sortie, "un mot entre quotes n'est jamais un opérateur")
+    sortie = `#{COMMANDESHELL} -c "echo a \\|2 \\> '&'"`
+    assert_equal("a |2 > &\n", sortie, "un opérateur échappé est un mot")
+    sortie = `#{COMMANDESHELL} -c "echo x |2toto"`
+    assert_equal("Command 2toto not recognized\n", sortie, "|2toto est un tube vers la commande 2toto")
+  end
+
+  def test_spawn_server
+    sortie = `#{COMMANDESHELL} --spawn-server -c "cd /\n/bin/pwd\necho toto | tr a-z A-Z"`
+    assert_equal("/\nTOTO\n", sortie, "le serveur de lancement doit reprendre le répertoire et les tubes du shell")
+  end
+
+  def test_status_pipeline
+    sortie, erreurs, _ = Open3.capture3(COMMANDESHELL, "-c", "yes | head -2")
+    assert_equal("y\ny\n", sortie, "yes | head -2 doit afficher deux lignes")
+    assert_equal("", erreurs, "la fin de yes par SIGPIPE ne doit pas être signalée")
+    sortie, erreurs, _ = Open3.capture3(COMMANDESHELL, "-c", "false | cat")
+    assert_equal("", sortie, "l'état des étapes ne doit pas se mêler à la sortie")
+    assert_equal("[stage 0] exited with status 1\n", erreurs, "l'échec d'une étape doit être signalé")
+  end
+
+  def test_erreur_redirection
+    ["", "--spawn-server"].each do |option|
+      sortie = `#{COMMANDESHELL} #{option} -c "ls > /nonexist/x"`
+      assert_equal("/nonexist/x: No such file or directory\n", sortie,
+                   "l'erreur doit désigner le fichier de la redirection et non la commande")
+      assert_equal(1, $?.exitstatus, "une redirection impossible rend 1")
+    end
+  end
+
+  def test_script_sans_diese
+    File.write("totoScript.sh", "echo sans diese $1\n")
+    File.chmod(0755, "totoScript.sh")
+    ["", "--spawn-server"].each do |option|
+      sortie = `#{COMMANDESHELL} #{option} -c "./totoScript.sh un"`
+      assert_equal("sans diese un\n", sortie, "un script sans #! doit être exécuté par /bin/sh")
+    end
+  end
+
+  def test_limits
+    debut = Time.now
+    sortie, erreurs, status = Open3.capture3(COMMANDESHELL, "-c", "timeout=0.2 sleep 10")
+    assert_operator(Time.now - debut, :<, 5, "timeout= doit tuer la commande")
+    assert_equal("", sortie, "la fin par timeout= ne doit pas se mêler à la sortie")
+    assert_equal("sleep 10: timed out\n", erreurs, "la fin de la commande par timeout= doit être signalée")
+    assert_equal(128 + 15, status.exitstatus, "la commande doit être tuée par SIGTERM")
+    `#{COMMANDESHELL} -c "ulimit -t 1
+sh -c 'while :; do :; done'"`
+    assert_equal(128 + 24, $?.exitstatus, "ulimit -t doit limiter le temps de calcul (SIGXCPU)")
+    # Fixée avant l'exec, la limite vaut dès la première commande lancée
+    sortie = `#{COMMANDESHELL} -c "ulimit -t 3
+sh -c 'cat /proc/self/limits' | grep 'Max cpu'"`
+    assert_match(/^Max cpu time +3 +4 +seconds/, sortie, "ulimit -t doit valoir pour les processus de la commande")
+  end
+
+  def test_record
+    File.delete("totoRecord.txt") if File.exist?("totoRecord.txt")
+    `#{COMMANDESHELL} --record totoRecord.txt -c "true\nfalse | cat\nfalse"`
+    trace = File.read("totoRecord.txt")
+    File.delete("totoRecord.txt")
+    assert_match(/\A# ensishell record \d+\.\d+\n\d+\.\d{6}\t\d+\.\d{6}\t0\ttrue\n.*\t0\tfalse \| cat\n.*\t1\tfalse\n\z/,
+                 trace, "--record doit enregistrer chaque ligne avec son code de retour")
+  end
+end
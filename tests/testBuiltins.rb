@@ -0,0 +1,111 @@
+# -*- coding: utf-8 -*-
+require "minitest/autorun"
+
+require "../tests/testConstantes"
+
+class Test5Builtins < Minitest::Test
+  test_order=:defined
+
+  def teardown
+    system("rm -f totoExpect.txt titiExpect.txt")
+  end
+
+  def test_redirection
+    sortie = `#{COMMANDESHELL} -c "echo toto > totoExpect.txt\ncat totoExpect.txt"`
+    assert_equal("toto\n", sortie, "echo ne respecte pas la redirection")
+  end
+
+  def test_pipe
+    sortie = `#{COMMANDESHELL} -c "printf '%s:%d\\\\n' a 1 b 2 | tr a-z A-Z"`
+    assert_equal("A:1\nB:2\n", sortie, "printf ne fonctionne pas dans un pipe")
+  end
+
+  def test_cd_pwd
+    sortie = `#{COMMANDESHELL} -c "cd /\npwd"`
+    assert_equal("/\n", sortie, "cd ne change pas le répertoire du shell")
+  end
+
+  def test_test
+    `#{COMMANDESHELL} -c "[ 2 -gt 1 -a -d / ]"`
+    assert_equal(0, $?.exitstatus, "[ 2 -gt 1 -a -d / ] doit être vrai")
+    `#{COMMANDESHELL} -c "test abc = abd"`
+    assert_equal(1, $?.exitstatus, "test abc = abd doit être faux")
+  end
+
+  def test_parallel
+    File.write("totoExpect.txt", "3\n1\n\n2\n")
+    sortie = `#{COMMANDESHELL} -c "parallel -j 2 -a totoExpect.txt echo n{} | sort" 2>/dev/null`
+    assert_equal("n1\nn2\nn3\n", sortie, "parallel doit lancer la commande pour chaque ligne")
+    sortie = `#{COMMANDESHELL} -c "parallel -j 99999999999 -a totoExpect.txt echo" 2>&1`
+    assert_equal("parallel: 99999999999: invalid number of tasks (1 to 1024)\n", sortie,
+                 "parallel doit refuser un -j démesuré")
+    assert_equal(2, $?.exitstatus, "un -j invalide est une erreur d'usage")
+  end
+
+  def test_fanout
+    `#{COMMANDESHELL} -c "printf '%s\\n' a b >+ totoExpect.txt titiExpect.txt"`
+    assert_equal("a\nb\n", File.read("totoExpect.txt"), ">+ n'écrit pas le premier fichier")
+    assert_equal("a\nb\n", File.read("titiExpect.txt"), ">+ n'écrit pas le second fichier")
+    sortie = `#{COMMANDESHELL} -c "echo toto | tee totoExpect.txt | tr a-z A-Z"`
+    assert_equal("TOTO\n", sortie, "tee doit recopier son entrée sur sa sortie")
+    assert_equal("toto\n", File.read("totoExpect.txt"), "tee n'écrit pas le fichier")
+  end
+
+  def test_pipesize
+    sortie = `#{COMMANDESHELL} -c "pipesize 256k
+pipesize
+pipesize=max,direct echo toto | cat"`
+    assert_match(/^pipesize 262144 \(max \d+\)\ntoto\n$/, sortie, "pipesize ne règle pas la taille des tubes")
+  end
+
+  def test_joblog
+    sortie = `#{COMMANDESHELL} -c "joblog on 4
+seq 1 10 &
+wait
+joblog %1" 2>/dev/null`
+    assert_match(/^\[1\] \d+\n\[1\] Le fils \[\d+: seq 1 10\] est termin.*\n10\njoblog: %1: no log\n\z/n, sortie.b,
+                 "la fin de la sortie du job doit suivre l'annonce de sa fin, puis le journal est libéré")
+    sortie = `#{COMMANDESHELL} -c "joblog on 4
+sh -c 'seq 1 10; sleep 5' &
+sleep 0.3
+joblog %1
+kill %1" 2>/dev/null`
+    assert_match(/\A\[1\] \d+\n10\n/n, sortie.b, "joblog doit garder la fin de la sortie d'un job en cours")
+    sortie = `#{COMMANDESHELL} -c "joblog on 100000m
+joblog" 2>&1`
+    assert_equal("joblog: 100000m: invalid size (1 to 64m)\njoblog off\n", sortie,
+                 "joblog doit refuser une taille démesurée")
+  end
+
+  def test_affinity
+    sortie = `#{COMMANDESHELL} -c "affinity 0
+affinity
+grep Cpus_allowed_list /proc/self/status"`
+    assert_match(/^affinity 0 \(\d+ cpus, \d+ nodes\)\nCpus_allowed_list:\t0\n$/, sortie,
+                 "affinity doit fixer les CPU des commandes lancées")
+  end
+
+  def test_stats
+    sortie = `ENSISHELL_STATS=totoExpect.txt #{COMMANDESHELL} -c "true\nstats"`
+    assert_match(/^parse +2 /, sortie, "stats doit compter les lignes analysées")
+    assert_match(/^builtin +2 /, File.read("totoExpect.txt"), "les statistiques doivent être écrites à la sortie")
+  end
+
+  def test_history
+    # Deux shells interactifs ajoutent au même fichier
+    `printf 'echo un\\necho deux\\n' | ENSISHELL_HISTORY=totoExpect.txt #{COMMANDESHELL} > /dev/null`
+    `printf 'echo trois\\n' | ENSISHELL_HISTORY=totoExpect.txt #{COMMANDESHELL} > /dev/null`
+    sortie = `ENSISHELL_HISTORY=totoExpect.txt #{COMMANDESHELL} -c "history 2\nhistory -s deux"`
+    assert_equal("echo deux\necho trois\necho deux\n", sortie, "history doit lire le fichier partagé")
+    # Assez de lignes pour que la recherche passe par l'index
+    File.open("totoExpect.txt", "a") do |f|
+      5000.times { |i| f.puts("ls -l fichier#{i}") }
+      f.puts("grep aiguille foin")
+      5000.times { |i| f.puts("ls -l fichier#{i}") }
+    end
+    sortie = `ENSISHELL_HISTORY=totoExpect.txt #{COMMANDESHELL} -c "history -s aiguille\nhistory -s fichier4999 1"`
+    assert_equal("grep aiguille foin\nls -l fichier4999\n", sortie, "history -s doit trouver les lignes les plus récentes")
+    assert(File.size("totoExpect.txt.idx") > 0, "la recherche doit construire l'index")
+    File.delete("totoExpect.txt.idx")
+  end
+end
@@ -3,6 +3,8 @@
 PROMPT=/^ensishell>/
 DELAI=1
 COMMANDESHELL="./ensishell"
+# Les shells des tests n'écrivent pas dans l'historique de l'utilisateur
+ENV["ENSISHELL_HISTORY"] = ""
 # PROMPT=/^.*\$/
 # DELAI=1
 # COMMANDESHELL="sh"
@@ -26,4 +26,43 @@ class Test3Jobs < Minitest::Test
     a = @pty_read.expect(/sleep/, DELAI)
     refute_nil(a, "jobs n'affiche pas le nom de la commande sleep")
   end
+
+  def test_kill_job
+    @pty_write.puts("sleep 10 &")
+    @pty_write.puts("kill %1")
+    @pty_write.puts("wait")
+    a = @pty_read.expect(/\[1\] Le fils \[\d+: sleep 10\] est termin/, DELAI)
+    refute_nil(a, "kill %1 n'a pas terminé le job 1")
+  end
+
+  def test_fg_job_termine
+    @pty_write.puts("sleep 0.2 &")
+    sleep 1
+    @pty_write.puts("fg")
+    @pty_write.puts("printf '%s-%s\\n' apres fg")
+    a = @pty_read.expect(/apres-fg/, DELAI)
+    refute_nil(a, "fg d'un job déjà terminé bloque le shell")
+  end
+
+  def test_bg_job_termine
+    @pty_read.binmode
+    @pty_write.puts("sleep 0.2 &")
+    sleep 1
+    @pty_write.puts("bg")
+    a = @pty_read.expect(/\[1\] Le fils \[\d+: sleep 0.2\] est termin/n, DELAI)
+    refute_nil(a, "bg d'un job déjà terminé ne le signale pas terminé")
+    @pty_write.puts("jobs")
+    @pty_write.puts("printf '%s-%s\\n' apres bg")
+    a = @pty_read.expect(/apres-bg/n, DELAI)
+    refute_nil(a, "le shell ne répond plus après bg")
+    refute_match(/Running/, a[0], "le job terminé est resté dans la table")
+  end
+
+  def test_time
+    @pty_write.puts("time -p sleep 0.2")
+    a = @pty_read.expect(/real 0\.[23]\d/, DELAI)
+    refute_nil(a, "time -p n'affiche pas le temps réel")
+    a = @pty_read.expect(/user \d+\.\d\d/, DELAI)
+    refute_nil(a, "time -p n'affiche pas le temps utilisateur")
+  end
 end
@@ -0,0 +1,35 @@
+# -*- coding: utf-8 -*-
+require "minitest/autorun"
+
+require "../tests/testConstantes"
+
+class Test6Scheme < Minitest::Test
+  test_order=:defined
+
+  def setup
+    # cmake écrit variante.h dans les sources
+    unless File.read("../src/variante.h", encoding: "binary") =~ /define USE_GUILE_JOBS 1/n
+      skip("ensishell compilé sans les procédures Scheme (cmake -DGUILE_JOBS=ON)")
+    end
+  end
+
+  def teardown
+    system("rm -f totoScript.sh totoExpect.txt titiExpect.txt")
+  end
+
+  def test_run_pipeline_spawn
+    File.write("totoScript.sh", <<~'SCHEME')
+      (begin (display (assq-ref (run '("sh" "-c" "exit 3")) 'status)) (newline))
+      (run '("echo" "pipe") #:out "totoExpect.txt")
+      (begin (display (assq-ref (pipeline '("cat" "totoExpect.txt") '("tr" "a-z" "A-Z") #:out "titiExpect.txt") 'status)) (newline))
+      (define job (spawn-async '("sh" "-c" "exit 4")))
+      (begin (display (assq-ref (wait-job job) 'status)) (newline) (force-output))
+    SCHEME
+    sortie = `#{COMMANDESHELL} totoScript.sh`
+    # Le numéro du job passe par stdout en C, le reste par le port de Guile
+    assert_match(/^\[\d+\] \d+$/, sortie, "spawn-async doit annoncer le job")
+    assert_equal(["3\n", "0\n", "4\n"], sortie.lines.grep_v(/^\[\d+\] \d+$/),
+                 "run, pipeline et wait-job doivent rendre le code de retour")
+    assert_equal("PIPE\n", File.read("titiExpect.txt"), "pipeline doit relier les commandes et rediriger la sortie")
+  end
+end